@@ -3,20 +3,113 @@
 #include "csbrk.h"
 
 //Place any variables needed here from umalloc.c or csbrk.c as an extern.
-extern memory_block_t *free_head;
-extern sbrk_block *sbrk_blocks;
+extern arena_t arenas[];
+extern size_t num_arenas;
+
+/*
+ * check_free_block - checks a block filed as free in the given arena under
+ * the given size class, NUM_SIZE_CLASSES standing for the large block tree.
+ * Returns 0 or the check_heap error code.
+ */
+static int check_free_block(memory_block_t *cur, size_t arena_id, size_t class) {
+    /*
+        Ensure every free block is unallocated, aligned and filed under the right arena and size class
+    */
+    if (is_allocated(cur)) {
+        return -2;
+    }
+    size_t pos = (size_t) get_payload(cur);
+    if (pos % ALIGNMENT != 0) {
+        return -3;
+    }
+    if (get_size_class(get_size(cur)) != class || get_arena_id(cur) != arena_id) {
+        return -10;
+    }
+
+    /*
+        Ensure that the boundary tag matches the header and that cur->next points back to cur with ->prev
+    */
+    size_t *footer = (void *) cur + get_entire_size(cur) - sizeof(size_t);
+    if (*footer != cur->block_size_alloc) {
+        return -4;
+    }
+    if (cur->next && cur->next->prev != cur) {
+        return -5;
+    }
+
+    /*
+        Ensure that cur's adjacent contiguous blocks are allocated (otherwise a coalesce was missed)
+        and that the proceeding block finds cur through its footer
+    */
+    if (has_preceeding(cur) && has_free_preceeding(cur)) {
+        return -6;
+    }
+    if (has_proceeding(cur)) {
+        memory_block_t * proceeding = get_proceeding(cur);
+        if (!has_free_preceeding(proceeding) || get_preceeding(proceeding) != cur) {
+            return -7;
+        }
+        if (!is_allocated(proceeding)) {
+            return -8;
+        }
+    }
+    return 0;
+}
+
+/*
+ * check_tree - checks a subtree of the large block tree whose sizes must lie
+ * strictly between low and high, along with the rings hanging off its nodes.
+ * Returns the subtree's black height or a negative error code.
+ */
+static int check_tree(tree_node_t *node, tree_node_t *parent, size_t low, size_t high, size_t arena_id, size_t *listed_free) {
+    if (!node) {
+        return 1;
+    }
+    size_t size = get_size(&node->block);
+    if (!node->in_tree || node->parent != parent || size <= low || size >= high) {
+        return -16;
+    }
+    if (node->red && ((node->child[0] && node->child[0]->red) || (node->child[1] && node->child[1]->red))) {
+        return -17;
+    }
+    memory_block_t *cur = &node->block;
+    do {
+        int status = check_free_block(cur, arena_id, NUM_SIZE_CLASSES);
+        if (status) {
+            return status;
+        }
+        if (get_size(cur) != size || (cur != &node->block && ((tree_node_t *) cur)->in_tree)) {
+            return -16;
+        }
+        (*listed_free)++;
+        cur = cur->next;
+    } while (cur != &node->block);
+
+    int left = check_tree(node->child[0], node, low, size, arena_id, listed_free);
+    if (left < 0) {
+        return left;
+    }
+    int right = check_tree(node->child[1], node, size, high, arena_id, listed_free);
+    if (right < 0) {
+        return right;
+    }
+    if (left != right) {
+        return -17;
+    }
+    return left + !node->red;
+}
 
 /*
  * check_heap -  used to check that the heap is still in a consistent state.
- 
+
  * STUDENT TODO:
  * Required to be completed for checkpoint 1:
  *      - Check that pointers in the free list point to valid free blocks. Blocks should be within the valid heap addresses: look at csbrk.h for some clues.
  *        They should also be allocated as free.
  *      - Check if any memory_blocks (free and allocated) overlap with each other. Hint: Run through the heap sequentially and check that
  *        for some memory_block n, memory_block n+1 has a sensible block_size and is within the valid heap addresses.
- *      - Ensure that each memory_block is aligned. 
- * 
+ *      - Ensure that each memory_block is aligned.
+ *
  * Should return 0 if the heap is still consistent, otherwise return a non-zero
  * return code. Asserts are also a useful tool here.
  */
@@ -24,67 +117,130 @@ int check_heap() {
     // Example heap check:
     // Check that all blocks in the free list are marked free.
     // If a block is marked allocated, return -1.
-    memory_block_t *cur = free_head;
+    size_t listed_free = 0;
+    size_t walked_free = 0;
+    size_t chunks = 0;
+    for (size_t arena_id = 0; arena_id < num_arenas; arena_id++) {
+        arena_t *arena = &arenas[arena_id];
+        for (size_t class = 0; class < NUM_SIZE_CLASSES; class++) {
+            memory_block_t *cur = arena->free_lists[class];
 
-    //ensure prev of head is NULL
-    if (cur && cur->prev) {
-        return -1;
-    }
+            //ensure the class's bit says whether the list is empty
+            if (!cur != !(arena->nonempty_classes & (1UL << class))) {
+                return -18;
+            }
+
+            //ensure prev of head is NULL
+            if (cur && cur->prev) {
+                return -1;
+            }
+
+            /*
+                Loop through the list to ensure every free block has no issues
+            */
+            while (cur) {
+                int status = check_free_block(cur, arena_id, class);
+                if (status) {
+                    return status;
+                }
+                listed_free++;
+                cur = cur->next;
+            }
+        }
 
-    /*
-        Loop through the list to ensure every free block has no issues
-    */
-    while (cur) {
         /*
-            Ensure every free block is unallocated and aligned
+            Ensure the frees held back in deferred coalescing mode are allocated blocks of the arena
         */
-        if (is_allocated(cur)) {
-            return -2;
+        if (arena->num_deferred >= DEFERRED_LIMIT) {
+            return -19;
         }
-        size_t pos = (size_t) cur;
-        if (pos % ALIGNMENT != 0) {
-            return -3;
+        for (size_t i = 0; i < arena->num_deferred; i++) {
+            memory_block_t *block = get_block(arena->deferred[i]);
+            if (!is_allocated(block) || is_mmapped(block) || get_arena_id(block) != arena_id) {
+                return -19;
+            }
         }
 
         /*
-            Ensure that cur->next points back to cur with ->prev and that there is no overlap between the blocks
+            Ensure the large block tree is ordered by size, balanced and that its root is black
         */
-
-        if (cur->next) {
-            size_t nextPos = (size_t) cur->next;
-            size_t size = get_size(cur);
-            if (pos + size + sizeof(memory_block_t) > nextPos) {
-                return -4;
-            }
-            if (cur->next->prev != cur) {
-                return -5;
-            }
+        if (arena->large_tree && (arena->large_tree->red || arena->large_tree->parent)) {
+            return -17;
+        }
+        int tree_status = check_tree(arena->large_tree, NULL, SMALL_CLASS_LIMIT - 1, SIZE_MASK, arena_id, &listed_free);
+        if (tree_status < 0) {
+            return tree_status;
         }
 
         /*
-            Ensure that cur's adjacent contiguous blocks link back to cur
+            Run through every chunk of the arena sequentially, blocks must tile each chunk exactly
+            between its header and slack, belong to the arena, the preceeding-free bit must agree
+            with the block before it, every free block must be on a list and the slack must point
+            at the last block
         */
-
-        if(has_preceeding(cur)) {
-            memory_block_t * preceeding = get_preceeding(cur);
-            if (!preceeding) {
-                return -6;
+        for (heap_chunk_t *chunk = arena->chunks; chunk; chunk = chunk->next) {
+            void *chunk_end = (void *) chunk + chunk->size - CHUNK_PAD;
+            memory_block_t *block = get_first_block(chunk);
+            if (has_preceeding(block)) {
+                return -13;
             }
-            if (get_proceeding(preceeding) != cur) {
-                return -7;
+            while (true) {
+                if ((size_t) get_payload(block) % ALIGNMENT != 0) {
+                    return -3;
+                }
+                if ((void *) block + get_entire_size(block) > chunk_end || get_arena_id(block) != arena_id) {
+                    return -11;
+                }
+                if (!is_allocated(block)) {
+                    walked_free++;
+                }
+                if (!has_proceeding(block)) {
+                    break;
+                }
+                memory_block_t *proceeding = get_proceeding(block);
+                if (!has_preceeding(proceeding) || has_free_preceeding(proceeding) == is_allocated(block)) {
+                    return -12;
+                }
+                block = proceeding;
             }
-        }
-        if (has_proceeding(cur)) {
-            memory_block_t * proceeding = get_proceeding(cur);
-            if (!proceeding) {
-                return -8;
+            if ((void *) block + get_entire_size(block) != chunk_end) {
+                return -11;
             }
-            if (get_preceeding(proceeding) != cur) {
-                return -9;
+            if (get_last_block(chunk) != block) {
+                return -20;
             }
+            chunks++;
         }
-        cur = cur->next;
+
+        /*
+            Ensure every slab with free slots is on the list of its class, is an allocated block of the arena
+            that the pagemap knows about, and that its bitmap agrees with its free count
+        */
+        for (size_t class = 0; class < NUM_SLAB_CLASSES; class++) {
+            slab_t *prev = NULL;
+            for (slab_t *slab = arena->slabs[class]; slab; slab = slab->next) {
+                if (slab->prev != prev || slab->slab_class != class || get_slab(slab) != slab) {
+                    return -14;
+                }
+                memory_block_t *block = get_block(slab);
+                if (!is_allocated(block) || get_arena_id(block) != arena_id || get_size(block) < SLAB_SIZE - HEADER_SIZE) {
+                    return -14;
+                }
+                size_t free_bits = 0;
+                for (size_t word = 0; word < SLAB_BITMAP_WORDS; word++) {
+                    free_bits += __builtin_popcountl(slab->free_slots[word]);
+                }
+                if (slab->num_free == 0 || slab->num_free > slab->num_slots || free_bits != slab->num_free) {
+                    return -15;
+                }
+                prev = slab;
+            }
+        }
+    }
+    // hand built heaps (see unittest.c) have free lists but no chunks to walk
+    if (chunks && walked_free != listed_free) {
+        return -9;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Checks that each trace replays the same requests from its text form and
+# from the binary form rep2bin converts it to, whether loaded whole or
+# streamed. Every form and path is printed back as text and compared with
+# the original, runner's results on both forms are compared, and
+# performance must replay both forms either way.
+if [ "$#" -eq 0 ]; then
+  echo "Usage: $0 trace..." >&2
+  exit 1
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+# same file file what - reports the trace as failed when the files differ
+same() {
+  if ! cmp -s "$1" "$2"; then
+    echo "$trace: $3 differ"
+    failed=1
+  fi
+}
+
+for trace in "$@"; do
+  failed=0
+  if ! ./rep2bin "$trace" "$dir/trace.bin"; then
+    echo "$trace: conversion failed"
+    status=1
+    continue
+  fi
+  # the header and the fields that are replayed, without a recorded thread or time
+  awk 'NR <= 2 { print $1; next } $1 == "f" { print $1, $2; next } NF { print $1, $2, $3 }' "$trace" > "$dir/expected"
+  ./rep2bin -d "$trace" > "$dir/text"
+  ./rep2bin -d "$dir/trace.bin" > "$dir/binary"
+  same "$dir/expected" "$dir/text" "the trace and its parsed requests"
+  same "$dir/text" "$dir/binary" "the text and binary requests"
+  ./rep2bin -ds "$trace" > "$dir/text.stream"
+  ./rep2bin -ds "$dir/trace.bin" > "$dir/binary.stream"
+  same "$dir/text" "$dir/text.stream" "the loaded and streamed text requests"
+  same "$dir/binary" "$dir/binary.stream" "the loaded and streamed binary requests"
+
+  ./runner -ru "$trace" > "$dir/text.out" 2>&1
+  ./runner -ru "$dir/trace.bin" > "$dir/binary.out" 2>&1
+  grep -q "passed correctness" "$dir/text.out" || { echo "$trace: runner failed"; failed=1; }
+  same "$dir/text.out" "$dir/binary.out" "runner's results on the text and binary trace"
+
+  for form in "$trace" "$dir/trace.bin"; do
+    for option in "" -s; do
+      ./performance $option "$form" | grep -q Success || { echo "$trace: performance $option failed on $form"; failed=1; }
+    done
+  done
+
+  [ $failed = 0 ] && echo "$trace: ok" || status=1
+done
+exit $status
@@ -0,0 +1,258 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * libumalloc.c - Exports the C allocation functions over umalloc so that
+ * libumalloc.so can replace the C library's allocator in any program:
+ *
+ *     LD_PRELOAD=./libumalloc.so program
+ *
+ * The heap is set up by the first call. Calls made while a thread is
+ * already inside umalloc, such as the C library allocating on behalf of
+ * uinit() or qsort(), and calls made before the heap is ready are served
+ * from a static bootstrap buffer instead of recursing into the allocator.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "csbrk.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CSBRK_LIMIT 65536 /* Most bytes csbrk hands out per call, like the lab's csbrk */
+#define BOOTSTRAP_SIZE (PAGESIZE * 64) /* Bytes of the buffer serving reentrant and early calls */
+#define BOOTSTRAP_HEADER ALIGNMENT /* Bytes in front of each bootstrap payload, holding its size */
+
+enum { HEAP_UNINITIALIZED, HEAP_INITIALIZING, HEAP_READY, HEAP_FAILED };
+
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(PAGESIZE)));
+static size_t bootstrap_used;
+static int heap_state = HEAP_UNINITIALIZED;
+static __thread bool inside;
+
+/*
+ * csbrk - sbrk with the lab's per call limit. The lab's csbrk.o is not
+ * position independent and its tracking variant allocates, so the library
+ * carries its own.
+ */
+void *csbrk(intptr_t increment) {
+    if (increment > CSBRK_LIMIT) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return sbrk(increment);
+}
+
+/*
+ * bootstrap_alloc - carves size bytes aligned to alignment out of the
+ * bootstrap buffer, which is never reused, so the memory is zero. Returns NULL
+ * once the buffer is used up.
+ */
+static void *bootstrap_alloc(size_t size, size_t alignment) {
+    alignment = alignment > ALIGNMENT ? alignment : ALIGNMENT;
+    if (size > BOOTSTRAP_SIZE || alignment > BOOTSTRAP_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t used = __atomic_load_n(&bootstrap_used, __ATOMIC_RELAXED);
+    size_t start, end;
+    do {
+        start = (used + BOOTSTRAP_HEADER + alignment - 1) & ~(alignment - 1);
+        end = ALIGN(start + size);
+        if (end > BOOTSTRAP_SIZE) {
+            errno = ENOMEM;
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&bootstrap_used, &used, end, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    *(size_t *) (bootstrap + start - sizeof(size_t)) = size;
+    return bootstrap + start;
+}
+
+static bool is_bootstrap(void *ptr) {
+    return (char *) ptr >= bootstrap && (char *) ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+static size_t bootstrap_size(void *ptr) {
+    return *(size_t *) ((char *) ptr - sizeof(size_t));
+}
+
+/*
+ * initialize - runs uinit() once, other threads wait for it to finish.
+ * Returns whether the heap is ready.
+ */
+static bool initialize() {
+    int state = HEAP_UNINITIALIZED;
+    if (__atomic_compare_exchange_n(&heap_state, &state, HEAP_INITIALIZING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        inside = true;
+        state = uinit() == 0 ? HEAP_READY : HEAP_FAILED;
+        inside = false;
+        __atomic_store_n(&heap_state, state, __ATOMIC_RELEASE);
+        return state == HEAP_READY;
+    }
+    while ((state = __atomic_load_n(&heap_state, __ATOMIC_ACQUIRE)) == HEAP_INITIALIZING) {
+        sched_yield();
+    }
+    return state == HEAP_READY;
+}
+
+/*
+ * enter - marks the calling thread as inside the allocator. Returns false when
+ * it already was, or the heap cannot be set up, and the call has to be served
+ * from the bootstrap buffer.
+ */
+static inline bool enter() {
+    if (inside) {
+        return false;
+    }
+    if (__atomic_load_n(&heap_state, __ATOMIC_ACQUIRE) != HEAP_READY && !initialize()) {
+        return false;
+    }
+    inside = true;
+    return true;
+}
+
+static inline void leave() {
+    inside = false;
+}
+
+void *malloc(size_t size) {
+    if (!enter()) {
+        return bootstrap_alloc(size, ALIGNMENT);
+    }
+    void *payload = umalloc(size);
+    leave();
+    if (!payload) {
+        errno = ENOMEM;
+    }
+    return payload;
+}
+
+/*
+ * free - bootstrap memory is never given back. A block freed while its
+ * thread is inside umalloc is leaked rather than risking a deadlock on the
+ * lock the thread already holds.
+ */
+void free(void *ptr) {
+    if (!ptr || is_bootstrap(ptr) || inside) {
+        return;
+    }
+    inside = true;
+    ufree(ptr);
+    leave();
+}
+
+/*
+ * free_sized - the C23 free that is told the size the memory was allocated
+ * with, which spares small frees a header read.
+ */
+void free_sized(void *ptr, size_t size) {
+    if (!ptr || is_bootstrap(ptr) || inside) {
+        return;
+    }
+    inside = true;
+    ufree_sized(ptr, size);
+    leave();
+}
+
+/*
+ * free_aligned_sized - the C23 free for memory from aligned_alloc(), only
+ * memory that needed no extra alignment can take the sized path.
+ */
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+    if (alignment <= ALIGNMENT) {
+        free_sized(ptr, size);
+    }
+    else {
+        free(ptr);
+    }
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(nmemb, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!enter()) {
+        return bootstrap_alloc(total, ALIGNMENT);
+    }
+    void *payload = ucalloc(nmemb, size);
+    leave();
+    if (!payload) {
+        errno = ENOMEM;
+    }
+    return payload;
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (!size) {
+        free(ptr);
+        return NULL;
+    }
+    if (is_bootstrap(ptr) || inside) {
+        size_t old_size = is_bootstrap(ptr) ? bootstrap_size(ptr) : umalloc_usable_size(ptr);
+        void *moved = malloc(size);
+        if (moved) {
+            memcpy(moved, ptr, old_size < size ? old_size : size);
+            free(ptr);
+        }
+        return moved;
+    }
+    inside = true;
+    void *payload = urealloc(ptr, size);
+    leave();
+    if (!payload) {
+        errno = ENOMEM;
+    }
+    return payload;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!enter()) {
+        return bootstrap_alloc(size, alignment);
+    }
+    void *payload = umemalign(alignment, size);
+    leave();
+    if (!payload) {
+        errno = ENOMEM;
+    }
+    return payload;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    void *payload = memalign(alignment, size);
+    if (!payload) {
+        return ENOMEM;
+    }
+    *memptr = payload;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    return memalign(PAGESIZE, size);
+}
+
+void *pvalloc(size_t size) {
+    return memalign(PAGESIZE, (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1));
+}
+
+size_t malloc_usable_size(void *ptr) {
+    if (ptr && is_bootstrap(ptr)) {
+        return bootstrap_size(ptr);
+    }
+    return umalloc_usable_size(ptr);
+}
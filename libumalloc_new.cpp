@@ -0,0 +1,125 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * libumalloc_new.cpp - The global C++ operator new and delete of
+ * libumalloc.so, on top of the C functions of libumalloc.c. Sized deletes
+ * pass their size on so that small blocks never have their header read.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include <cstdlib>
+#include <new>
+
+extern "C" {
+void free_sized(void *ptr, std::size_t size);
+void free_aligned_sized(void *ptr, std::size_t alignment, std::size_t size);
+void *memalign(std::size_t alignment, std::size_t size);
+}
+
+/*
+ * allocate - allocates like malloc(), or memalign() for alignments beyond
+ * ALIGNMENT, calling the new handler until it succeeds. Throws bad_alloc
+ * when there is no handler.
+ */
+static void *allocate(std::size_t size, std::size_t alignment) {
+    while (true) {
+        void *payload = alignment <= ALIGNMENT ? std::malloc(size) : memalign(alignment, size);
+        if (payload) {
+            return payload;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void *allocate_nothrow(std::size_t size, std::size_t alignment) noexcept {
+    try {
+        return allocate(size, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new(std::size_t size) {
+    return allocate(size, ALIGNMENT);
+}
+
+void *operator new[](std::size_t size) {
+    return allocate(size, ALIGNMENT);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, ALIGNMENT);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, ALIGNMENT);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate_nothrow(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept {
+    free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept {
+    free_sized(ptr, size);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t alignment) noexcept {
+    free_aligned_sized(ptr, static_cast<std::size_t>(alignment), size);
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t alignment) noexcept {
+    free_aligned_sized(ptr, static_cast<std::size_t>(alignment), size);
+}
@@ -0,0 +1,122 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * mt_bench.c - Measures how umalloc/ufree throughput scales with the number
+ * of threads. Every thread churns a private set of live blocks with random
+ * small sizes, so the ideal result is linear scaling.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "support.h"
+#include <pthread.h>
+
+#define LIVE_BLOCKS 64 /* blocks each thread keeps alive while churning */
+
+static size_t pairs = 1000000;
+static size_t max_size = 256;
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: mt_bench [-h] [-t threads] [-n pairs] [-s size]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t threads Largest thread count to run, doubling from 1 (default 8).\n");
+    fprintf(stderr, "\t-n pairs   umalloc/ufree pairs per thread (default 1000000).\n");
+    fprintf(stderr, "\t-s size    Largest request size in bytes (default 256).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+/*
+ * churn - Replaces a random live block with a fresh allocation of a random
+ * size, pairs times, then frees whatever is still live.
+ */
+static void *churn(void *arg) {
+    unsigned int seed = (unsigned int) (size_t) arg;
+    char *live[LIVE_BLOCKS] = { NULL };
+
+    for (size_t i = 0; i < pairs; i++) {
+        size_t slot = rand_r(&seed) % LIVE_BLOCKS;
+        if (live[slot]) {
+            ufree(live[slot]);
+        }
+        size_t size = 1 + rand_r(&seed) % max_size;
+        live[slot] = umalloc(size);
+        if (!live[slot]) {
+            appl_error("umalloc failed.");
+        }
+        live[slot][0] = (char) i;
+    }
+    for (size_t slot = 0; slot < LIVE_BLOCKS; slot++) {
+        if (live[slot]) {
+            ufree(live[slot]);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * run - Runs num_threads churning threads to completion and returns the
+ * elapsed wall time in microseconds.
+ */
+static uint64_t run(size_t num_threads) {
+    pthread_t threads[num_threads];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t t = 0; t < num_threads; t++) {
+        if (pthread_create(&threads[t], NULL, churn, (void *) (t + 1)) != 0) {
+            appl_error("pthread_create failed.");
+        }
+    }
+    for (size_t t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+int main(int argc, char **argv) {
+    size_t max_threads = 8;
+    int c;
+
+    while ((c = getopt(argc, argv, "ht:n:s:")) != -1) {
+        switch (c) {
+        case 't':
+            max_threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            pairs = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            max_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (max_threads == 0 || pairs == 0 || max_size == 0) {
+        usage();
+        appl_error("Thread count, pairs and size must be positive.");
+    }
+
+    if (uinit() == -1) {
+        appl_error("uinit failed.");
+    }
+
+    printf("%8s %12s %16s %10s\n", "threads", "time (us)", "pairs per ms", "speedup");
+    double base = 0;
+    for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        uint64_t delta_us = run(num_threads);
+        double throughput = (double) (pairs * num_threads) * 1000 / (delta_us ? delta_us : 1);
+        if (num_threads == 1) {
+            base = throughput;
+        }
+        printf("%8zu %12lu %16.0f %9.2fx\n", num_threads, delta_us, throughput, throughput / base);
+    }
+    return 0;
+}
@@ -9,37 +9,286 @@
 
 #include "umalloc.h"
 #include "support.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
+#define NUM_SIZE_BUCKETS 12 /* request sizes up to 16, 32, ... 16K bytes, then all larger together */
+#define DEFAULT_WORST 10 /* slowest operations listed in latency mode */
+
+/* One timed operation */
+typedef struct {
+    uint64_t ticks;   /* cycle counter ticks the call took */
+    int op;           /* index of the operation in the trace */
+    int size;         /* bytes allocated or freed */
+    int group;        /* op type * NUM_SIZE_BUCKETS + size bucket */
+} sample_t;
+
+static const char *op_names[] = { "alloc", "free", "realloc" };
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: performance [-h] [-l | -s] [-w worst] file\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-l         Time every operation and report latency percentiles.\n");
+    fprintf(stderr, "\t-s         Stream the trace in windows instead of loading it, for traces too big for memory.\n");
+    fprintf(stderr, "\t-w worst   Trace lines of the slowest operations to list with -l (default %d).\n", DEFAULT_WORST);
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "Without -l the run is timed in CPU time of the replaying thread, with or without -s.\n");
+}
+
+/*
+ * read_ticks - reads a cycle counter that is cheap enough to wrap a single
+ * call, the time stamp counter where there is one.
+ */
+static inline uint64_t read_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+
+/*
+ * size_bucket - maps a request size to its power-of-two bucket.
+ */
+static int size_bucket(int size) {
+    int bucket = 0;
+    while (bucket < NUM_SIZE_BUCKETS - 1 && size > (16 << bucket)) {
+        bucket++;
+    }
+    return bucket;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    const sample_t *x = a;
+    const sample_t *y = b;
+    if (x->group != y->group) {
+        return x->group - y->group;
+    }
+    return (x->ticks > y->ticks) - (x->ticks < y->ticks);
+}
+
+static int compare_slowest(const void *a, const void *b) {
+    const sample_t *x = a;
+    const sample_t *y = b;
+    return (x->ticks < y->ticks) - (x->ticks > y->ticks);
+}
+
+/*
+ * percentile - returns the pth percentile of count sorted samples, nearest
+ * rank.
+ */
+static uint64_t percentile(sample_t *sorted, size_t count, double p) {
+    size_t rank = (size_t) (p / 100 * count + 0.999999);
+    return sorted[(rank ? rank : 1) - 1].ticks;
+}
+
+/*
+ * run_trace - Runs the trace and prints the microseconds it took, measured
+ * with the thread's CPU clock like run_trace_stream so that both report the
+ * same kind of time.
+ */
 static void run_trace(trace_t *trace) {
 
     struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
     uinit();
     for(size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
         if (curr_op % 5 == 0) {
             sbrk(4096);
         }
-        traceop_t op = trace->ops[curr_op];
+        traceop_t op = trace_op(trace, curr_op);
         if (op.type == ALLOC) {
             trace->blocks[op.index].payload = umalloc(op.size);
+        } else if (op.type == REALLOC) {
+            trace->blocks[op.index].payload = urealloc(trace->blocks[op.index].payload, op.size);
         } else {
             ufree(trace->blocks[op.index].payload);
         }
     }
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
     uint64_t delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
     printf("Success: %ld", delta_us);
 }
 
+/*
+ * run_trace_stream - Runs the trace like run_trace, reading it a window at a
+ * time while it runs. Only the payloads of live ids are kept, so memory
+ * scales with the live set rather than the length of the trace. The run is
+ * timed with the thread's CPU clock so that the reader parsing the next window
+ * is not counted, even when it shares a core with the replay.
+ */
+static void run_trace_stream(char *filename) {
+    trace_stream_t *stream = open_trace_stream(filename, 0);
+    live_map_t live;
+    live_map_init(&live);
+    const trace_record_t *records;
+    size_t count;
+    size_t curr_op = 0;
 
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    uinit();
+    while ((count = next_window(stream, &records))) {
+        for (size_t i = 0; i < count; i++, curr_op++) {
+            if (curr_op % 5 == 0) {
+                sbrk(4096);
+            }
+            traceop_t op = decode_op(records[i]);
+            live_block_t *block;
+            if (op.type == ALLOC) {
+                block = live_map_insert(&live, op.index);
+                block->payload = umalloc(op.size);
+            } else if (op.type == REALLOC) {
+                block = live_map_insert(&live, op.index);
+                block->payload = urealloc(block->payload, op.size);
+            } else if ((block = live_map_find(&live, op.index))) {
+                ufree(block->payload);
+                live_map_remove(&live, block);
+            }
+        }
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    uint64_t delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    printf("Success: %ld", delta_us);
+    live_map_destroy(&live);
+    close_trace_stream(stream);
+}
+
+/*
+ * run_trace_latency - Runs the trace like run_trace, but reads the cycle
+ * counter around every umalloc/ufree and prints the p50, p90, p99, p99.9 and
+ * max latency per operation type and size bucket, followed by the trace lines
+ * of the worst slowest operations. Ticks are converted to nanoseconds with
+ * the rate measured over the whole run.
+ */
+static void run_trace_latency(trace_t *trace, size_t worst) {
+    sample_t *samples = malloc(trace->num_ops * sizeof(sample_t));
+    if (!samples) {
+        appl_error("Could not allocate samples.");
+    }
 
-int main(int argc, char **argv) { 
-    if (argc < 2) {
-        fprintf(stderr, "Usage: performance file\n");
+    struct timespec start, end;
+    uinit();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t first = read_ticks();
+    for(size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        if (curr_op % 5 == 0) {
+            sbrk(4096);
+        }
+        traceop_t op = trace_op(trace, curr_op);
+        uint64_t before, after;
+        if (op.type == ALLOC) {
+            before = read_ticks();
+            trace->blocks[op.index].payload = umalloc(op.size);
+            after = read_ticks();
+            trace->blocks[op.index].block_size = op.size;
+        } else if (op.type == REALLOC) {
+            before = read_ticks();
+            trace->blocks[op.index].payload = urealloc(trace->blocks[op.index].payload, op.size);
+            after = read_ticks();
+            trace->blocks[op.index].block_size = op.size;
+        } else {
+            before = read_ticks();
+            ufree(trace->blocks[op.index].payload);
+            after = read_ticks();
+        }
+        samples[curr_op].ticks = after - before;
+        samples[curr_op].op = curr_op;
+        samples[curr_op].size = trace->blocks[op.index].block_size;
+        samples[curr_op].group = op.type * NUM_SIZE_BUCKETS + size_bucket(samples[curr_op].size);
+    }
+    uint64_t last = read_ticks();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    double ns_per_tick = last > first ? elapsed_ns / (last - first) : 1;
+
+    printf("%-7s %8s %10s %10s %10s %10s %10s %10s\n", "op", "size", "count", "p50", "p90", "p99", "p99.9", "max");
+    qsort(samples, trace->num_ops, sizeof(sample_t), compare_samples);
+    for (size_t begin = 0, stop; begin < trace->num_ops; begin = stop) {
+        int group = samples[begin].group;
+        for (stop = begin; stop < trace->num_ops && samples[stop].group == group; stop++) {
+        }
+        size_t count = stop - begin;
+        int bucket = group % NUM_SIZE_BUCKETS;
+        char size[16];
+        if (bucket == NUM_SIZE_BUCKETS - 1) {
+            snprintf(size, sizeof(size), ">%d", 16 << (bucket - 1));
+        }
+        else {
+            snprintf(size, sizeof(size), "<=%d", 16 << bucket);
+        }
+        printf("%-7s %8s %10zu", op_names[group / NUM_SIZE_BUCKETS], size, count);
+        double points[] = { 50, 90, 99, 99.9 };
+        for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+            printf(" %10.0f", percentile(samples + begin, count, points[i]) * ns_per_tick);
+        }
+        printf(" %10.0f\n", samples[stop - 1].ticks * ns_per_tick);
+    }
+    printf("(nanoseconds, %.3f per tick)\n", ns_per_tick);
+
+    worst = worst < trace->num_ops ? worst : trace->num_ops;
+    if (worst) {
+        printf("\n%-6s %7s %8s %10s\n", "line", "op", "size", "ns");
+        qsort(samples, trace->num_ops, sizeof(sample_t), compare_slowest);
+        for (size_t i = 0; i < worst; i++) {
+            traceop_t op = trace_op(trace, samples[i].op);
+            printf("%-6d %7s %8d %10.0f\n", LINENUM(samples[i].op), op_names[op.type],
+                   samples[i].size, samples[i].ticks * ns_per_tick);
+        }
+    }
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    bool latency = false;
+    bool stream = false;
+    size_t worst = DEFAULT_WORST;
+    int c;
+
+    while ((c = getopt(argc, argv, "hlsw:")) != -1) {
+        switch (c) {
+        case 's':
+            stream = true;
+            break;
+        case 'l':
+            latency = true;
+            break;
+        case 'w':
+            worst = strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind >= argc) {
+        usage();
         appl_error("No File parameter provided.");
     }
-    trace_t *trace = read_trace(argv[1], 0);
-    run_trace(trace);
+    if (stream) {
+        if (latency) {
+            usage();
+            appl_error("-l keeps a sample per operation and cannot stream.");
+        }
+        run_trace_stream(argv[optind]);
+        return 0;
+    }
+    trace_t *trace = read_trace(argv[optind], 0);
+    if (latency) {
+        run_trace_latency(trace, worst);
+    }
+    else {
+        run_trace(trace);
+    }
     free_trace(trace);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,132 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * pmr_bench.cpp - Measures std::vector, std::unordered_map and std::map churn
+ * with the default allocator against umalloc_allocator and the umalloc
+ * backed pmr resources of umalloc.hpp.
+ **************************************************************************/
+
+#include "umalloc.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <unistd.h>
+
+static std::size_t rounds = 200;
+static std::size_t elements = 10000;
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage() {
+    std::fprintf(stderr, "Usage: pmr_bench [-h] [-r rounds] [-n elements]\n");
+    std::fprintf(stderr, "Options\n");
+    std::fprintf(stderr, "\t-r rounds   Times each container is filled and emptied (default 200).\n");
+    std::fprintf(stderr, "\t-n elements Elements per fill (default 10000).\n");
+    std::fprintf(stderr, "\t-h          Print this message.\n");
+}
+
+/*
+ * churn_vector - grows a vector element by element and drops it, rounds times,
+ * calling after_round once each is dropped.
+ */
+template <class Vector, class... Args>
+static void churn_vector(const std::function<void()> &after_round, Args &&...args) {
+    for (std::size_t round = 0; round < rounds; round++) {
+        {
+            Vector vector(args...);
+            for (std::size_t i = 0; i < elements; i++) {
+                vector.push_back(i);
+            }
+        }
+        after_round();
+    }
+}
+
+/*
+ * churn_map - fills a map with random keys and erases every other one before
+ * dropping it, rounds times, so that frees interleave with allocations, and
+ * calls after_round once each is dropped.
+ */
+template <class Map, class... Args>
+static void churn_map(const std::function<void()> &after_round, Args &&...args) {
+    std::mt19937_64 random(42);
+    for (std::size_t round = 0; round < rounds; round++) {
+        {
+            Map map(args...);
+            for (std::size_t i = 0; i < elements; i++) {
+                map[random() % (elements * 4)] = i;
+                if (i % 2) {
+                    map.erase(random() % (elements * 4));
+                }
+            }
+        }
+        after_round();
+    }
+}
+
+/*
+ * time_us - runs work and returns the elapsed wall time in microseconds.
+ */
+static long time_us(const std::function<void()> &work) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "hr:n:")) != -1) {
+        switch (c) {
+        case 'r':
+            rounds = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'n':
+            elements = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'h':
+            usage();
+            std::exit(0);
+        default:
+            usage();
+            std::exit(1);
+        }
+    }
+    if (uinit() == -1) {
+        std::fprintf(stderr, "uinit failed.\n");
+        return 1;
+    }
+
+    using key_t = std::size_t;
+    using umalloc_pair = umalloc_allocator<std::pair<const key_t, std::size_t>>;
+    using std_umap = std::unordered_map<key_t, std::size_t>;
+    using umalloc_umap = std::unordered_map<key_t, std::size_t, std::hash<key_t>, std::equal_to<key_t>, umalloc_pair>;
+    umalloc_pool_resource pool;
+    umalloc_monotonic_resource monotonic;
+    auto nothing = [] {};
+    // the monotonic resource is emptied once a round, which is how it is meant to be used
+    auto release = [&] { monotonic.release(); };
+
+    std::printf("%-16s %12s %12s %12s %14s\n", "container", "std (us)", "umalloc (us)", "pool (us)", "monotonic (us)");
+    std::printf("%-16s %12ld %12ld %12ld %14ld\n", "vector",
+                time_us([&] { churn_vector<std::vector<std::size_t>>(nothing); }),
+                time_us([&] { churn_vector<std::vector<std::size_t, umalloc_allocator<std::size_t>>>(nothing); }),
+                time_us([&] { churn_vector<std::pmr::vector<std::size_t>>(nothing, &pool); }),
+                time_us([&] { churn_vector<std::pmr::vector<std::size_t>>(release, &monotonic); }));
+    std::printf("%-16s %12ld %12ld %12ld %14ld\n", "unordered_map",
+                time_us([&] { churn_map<std_umap>(nothing); }),
+                time_us([&] { churn_map<umalloc_umap>(nothing); }),
+                time_us([&] { churn_map<std::pmr::unordered_map<key_t, std::size_t>>(nothing, &pool); }),
+                time_us([&] { churn_map<std::pmr::unordered_map<key_t, std::size_t>>(release, &monotonic); }));
+    std::printf("%-16s %12ld %12ld %12ld %14ld\n", "map",
+                time_us([&] { churn_map<std::map<key_t, std::size_t>>(nothing); }),
+                time_us([&] { churn_map<std::map<key_t, std::size_t, std::less<key_t>, umalloc_pair>>(nothing); }),
+                time_us([&] { churn_map<std::pmr::map<key_t, std::size_t>>(nothing, &pool); }),
+                time_us([&] { churn_map<std::pmr::map<key_t, std::size_t>>(release, &monotonic); }));
+    return 0;
+}
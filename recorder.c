@@ -0,0 +1,485 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * recorder.c - An allocation trace recorder. Preloaded into a program,
+ *
+ *     UMALLOC_TRACE=out.rep LD_PRELOAD=./librecorder.so program
+ *
+ * it passes every allocation call on to the C library and logs it, then
+ * writes the log out as a trace read_trace() understands when the program
+ * exits (umalloc.<pid>.rep when UMALLOC_TRACE is not set). Each line carries
+ * the recording thread's id and the nanoseconds since the recording started
+ * after the fields read_trace() uses:
+ *
+ *     a <id> <bytes> <tid> <ns>
+ *     r <id> <bytes> <tid> <ns>
+ *     f <id> <tid> <ns>
+ *
+ * Every thread logs into a buffer of its own that is appended to a raw event
+ * file with a single write once full, so that recording adds no locking and
+ * few system calls to the program. At exit the events of all threads are
+ * merged by time and addresses are mapped to dense ids, the id of a freed
+ * block being reused by the next allocation.
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVENTS_PER_BUFFER 4096 /* Events a thread logs before appending them to the raw file */
+#define MAX_PATH 4096
+
+/* The C library's allocator, which every call is passed on to */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+/*
+ * A realloc logs EVENT_REALLOC_OLD before the C library may free the old
+ * address, then EVENT_REALLOC with the new address, or EVENT_REALLOC_FAILED
+ * when the old one stays.
+ */
+enum { EVENT_ALLOC, EVENT_FREE, EVENT_REALLOC, EVENT_REALLOC_OLD, EVENT_REALLOC_FAILED };
+
+/* One logged call */
+typedef struct {
+    uint64_t time;   /* nanoseconds since the recording started */
+    uint64_t ptr;    /* address returned, or given up for EVENT_FREE and EVENT_REALLOC_OLD */
+    uint32_t size;   /* bytes requested, clamped to INT_MAX as traceop_t sizes are int */
+    uint16_t type;
+    uint16_t pad;
+    uint32_t tid;    /* kernel id of the calling thread */
+    uint32_t id;     /* the thread's sequence number, then the dense block id once the trace is written */
+} event_t;
+
+/* A thread's buffer of events not yet appended to the raw file */
+typedef struct thread_log_struct {
+    struct thread_log_struct *next;
+    int busy;        /* held while logging or flushing */
+    int in_use;      /* cleared when the owning thread exits, so another can take the buffer */
+    uint32_t tid;
+    uint32_t sequence;
+    size_t count;
+    event_t events[EVENTS_PER_BUFFER];
+} thread_log_t;
+
+static char trace_path[MAX_PATH];
+static char raw_path[MAX_PATH + 8];
+static int raw_fd = -1;
+static uint64_t start_ns;
+static bool recording;
+static thread_log_t *logs;
+static pthread_key_t log_key;
+static __thread thread_log_t *thread_log;
+static __thread bool inside;
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+static void lock_log(thread_log_t *log) {
+    while (__atomic_exchange_n(&log->busy, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+static void unlock_log(thread_log_t *log) {
+    __atomic_store_n(&log->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * flush_log - appends a buffer's events to the raw file, the buffer must be
+ * locked.
+ */
+static void flush_log(thread_log_t *log) {
+    size_t bytes = log->count * sizeof(event_t);
+    char *next = (char *) log->events;
+    while (bytes) {
+        ssize_t written = write(raw_fd, next, bytes);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        next += written;
+        bytes -= written;
+    }
+    log->count = 0;
+}
+
+/*
+ * log_destructor - flushes an exiting thread's buffer and hands it over to
+ * the next thread that needs one, buffers never leave the list.
+ */
+static void log_destructor(void *arg) {
+    thread_log_t *log = arg;
+    lock_log(log);
+    flush_log(log);
+    unlock_log(log);
+    __atomic_store_n(&log->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * get_log - returns the calling thread's buffer, taking over the buffer of
+ * an exited thread or mapping and listing a new one on its first call.
+ */
+static thread_log_t *get_log() {
+    if (thread_log) {
+        return thread_log;
+    }
+    thread_log_t *log;
+    for (log = __atomic_load_n(&logs, __ATOMIC_ACQUIRE); log; log = log->next) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&log->in_use, &unused, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (!log) {
+        log = mmap(NULL, sizeof(thread_log_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (log == MAP_FAILED) {
+            return NULL;
+        }
+        log->in_use = 1;
+        log->next = __atomic_load_n(&logs, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&logs, &log->next, log, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    log->tid = syscall(SYS_gettid);
+    thread_log = log;
+    pthread_setspecific(log_key, log);
+    return log;
+}
+
+/*
+ * record - logs a call. Calls the C library makes while the recorder itself
+ * is running, and calls before or after the recording, are left out.
+ */
+static void record(int type, void *ptr, size_t size) {
+    if (!__atomic_load_n(&recording, __ATOMIC_ACQUIRE) || inside) {
+        return;
+    }
+    inside = true;
+    thread_log_t *log = get_log();
+    if (log) {
+        lock_log(log);
+        event_t *event = &log->events[log->count++];
+        event->time = now_ns() - start_ns;
+        event->ptr = (uintptr_t) ptr;
+        event->size = size < INT_MAX ? size : INT_MAX;
+        event->type = type;
+        event->tid = log->tid;
+        event->id = log->sequence++;
+        if (log->count == EVENTS_PER_BUFFER) {
+            flush_log(log);
+        }
+        unlock_log(log);
+    }
+    inside = false;
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    if (ptr) {
+        record(EVENT_ALLOC, ptr, size);
+    }
+    return ptr;
+}
+
+/*
+ * free - logged before the memory is given back, so that an allocation
+ * reusing it on another thread is always logged later.
+ */
+void free(void *ptr) {
+    if (ptr) {
+        record(EVENT_FREE, ptr, 0);
+    }
+    __libc_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    void *ptr = __libc_calloc(nmemb, size);
+    if (ptr) {
+        record(EVENT_ALLOC, ptr, nmemb * size);
+    }
+    return ptr;
+}
+
+/*
+ * realloc - the old address is logged before the C library may free it, like
+ * in free(), and the new one after it is handed out, like in malloc().
+ */
+void *realloc(void *old, size_t size) {
+    if (!old) {
+        return malloc(size);
+    }
+    if (!size) {
+        free(old);
+        return NULL;
+    }
+    record(EVENT_REALLOC_OLD, old, 0);
+    void *ptr = __libc_realloc(old, size);
+    if (ptr) {
+        record(EVENT_REALLOC, ptr, size);
+    }
+    else {
+        record(EVENT_REALLOC_FAILED, old, 0);
+    }
+    return ptr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    if (ptr) {
+        record(EVENT_ALLOC, ptr, size);
+    }
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    void *ptr = memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+/*
+ * Address to id map, open addressing with linear probing and backward shift
+ * deletion. Used only while writing the trace.
+ */
+typedef struct {
+    uint64_t *keys;
+    uint32_t *ids;
+    size_t mask;
+} id_map_t;
+
+static size_t map_slot(id_map_t *map, uint64_t key) {
+    size_t slot = (key * 0x9E3779B97F4A7C15UL >> 20) & map->mask;
+    while (map->keys[slot] && map->keys[slot] != key) {
+        slot = (slot + 1) & map->mask;
+    }
+    return slot;
+}
+
+static void map_remove(id_map_t *map, size_t slot) {
+    map->keys[slot] = 0;
+    for (size_t next = (slot + 1) & map->mask; map->keys[next]; next = (next + 1) & map->mask) {
+        uint64_t key = map->keys[next];
+        map->keys[next] = 0;
+        size_t home = map_slot(map, key);
+        map->keys[home] = key;
+        map->ids[home] = map->ids[next];
+    }
+}
+
+/*
+ * compare_events - orders events by time, a thread's events that share a
+ * timestamp stay in the order they were logged.
+ */
+static int compare_events(const void *a, const void *b) {
+    const event_t *x = a;
+    const event_t *y = b;
+    if (x->time != y->time) {
+        return (x->time > y->time) - (x->time < y->time);
+    }
+    if (x->tid != y->tid) {
+        return (x->tid > y->tid) - (x->tid < y->tid);
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/*
+ * write_trace - merges the raw events by time, gives each live address a
+ * dense id and writes the trace. Frees and reallocations of addresses that
+ * were never seen allocated, such as memory from before the recording, are
+ * dropped, and so are reallocations whose events were lost. Between the two
+ * events of a realloc its id is held by the thread, in pending, so that
+ * another thread reusing the old address gets an id of its own.
+ */
+static void write_trace(event_t *events, size_t count) {
+    qsort(events, count, sizeof(event_t), compare_events);
+
+    id_map_t map;
+    size_t capacity = 1024;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    map.mask = capacity - 1;
+    map.keys = __libc_calloc(capacity, sizeof(uint64_t));
+    map.ids = __libc_malloc(capacity * sizeof(uint32_t));
+    id_map_t pending = { __libc_calloc(capacity, sizeof(uint64_t)), __libc_malloc(capacity * sizeof(uint32_t)), capacity - 1 };
+    uint32_t *free_ids = __libc_malloc((count + 1) * sizeof(uint32_t));
+    if (!map.keys || !map.ids || !pending.keys || !pending.ids || !free_ids) {
+        fprintf(stderr, "recorder: out of memory writing %s\n", trace_path);
+        return;
+    }
+
+    size_t num_free_ids = 0;
+    uint32_t num_ids = 0;
+    size_t num_ops = 0;
+    for (size_t i = 0; i < count; i++) {
+        event_t *event = &events[i];
+        if (event->type == EVENT_ALLOC) {
+            size_t slot = map_slot(&map, event->ptr);
+            // the free of a stale entry was not logged, the address is live again
+            if (!map.keys[slot]) {
+                map.keys[slot] = event->ptr;
+                map.ids[slot] = num_free_ids ? free_ids[--num_free_ids] : num_ids++;
+            }
+            event->id = map.ids[slot];
+        }
+        else if (event->type == EVENT_FREE || event->type == EVENT_REALLOC_OLD) {
+            size_t slot = map_slot(&map, event->ptr);
+            if (!map.keys[slot]) {
+                event->type = UINT16_MAX;
+                continue;
+            }
+            event->id = map.ids[slot];
+            map_remove(&map, slot);
+            if (event->type == EVENT_REALLOC_OLD) {
+                // thread ids are never 0, which marks an empty slot
+                slot = map_slot(&pending, event->tid);
+                pending.keys[slot] = event->tid;
+                pending.ids[slot] = event->id;
+                continue;
+            }
+            free_ids[num_free_ids++] = event->id;
+        }
+        else {
+            size_t slot = map_slot(&pending, event->tid);
+            if (!pending.keys[slot]) {
+                event->type = UINT16_MAX;
+                continue;
+            }
+            event->id = pending.ids[slot];
+            map_remove(&pending, slot);
+            slot = map_slot(&map, event->ptr);
+            // the free of a stale entry was not logged, its id is given up
+            if (map.keys[slot]) {
+                free_ids[num_free_ids++] = map.ids[slot];
+            }
+            map.keys[slot] = event->ptr;
+            map.ids[slot] = event->id;
+            if (event->type == EVENT_REALLOC_FAILED) {
+                continue;
+            }
+        }
+        num_ops++;
+    }
+
+    FILE *trace = fopen(trace_path, "w");
+    if (!trace) {
+        fprintf(stderr, "recorder: could not open %s\n", trace_path);
+    }
+    else {
+        fprintf(trace, "%u\n%zu\n", num_ids ? num_ids : 1, num_ops);
+        for (size_t i = 0; i < count; i++) {
+            event_t *event = &events[i];
+            if (event->type == EVENT_ALLOC) {
+                fprintf(trace, "a %u %u %u %lu\n", event->id, event->size, event->tid, event->time);
+            }
+            else if (event->type == EVENT_REALLOC) {
+                fprintf(trace, "r %u %u %u %lu\n", event->id, event->size, event->tid, event->time);
+            }
+            else if (event->type == EVENT_FREE) {
+                fprintf(trace, "f %u %u %lu\n", event->id, event->tid, event->time);
+            }
+        }
+        fclose(trace);
+    }
+    __libc_free(map.keys);
+    __libc_free(map.ids);
+    __libc_free(pending.keys);
+    __libc_free(pending.ids);
+    __libc_free(free_ids);
+}
+
+/*
+ * stop_recording - stops logging, flushes every thread's buffer and turns the
+ * raw file into the trace.
+ */
+__attribute__((destructor))
+static void stop_recording() {
+    if (!__atomic_exchange_n(&recording, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    inside = true;
+    for (thread_log_t *log = __atomic_load_n(&logs, __ATOMIC_ACQUIRE); log; log = log->next) {
+        lock_log(log);
+        flush_log(log);
+        unlock_log(log);
+    }
+    struct stat raw_stat;
+    if (fstat(raw_fd, &raw_stat) == 0 && raw_stat.st_size >= sizeof(event_t)) {
+        event_t *events = mmap(NULL, raw_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, raw_fd, 0);
+        if (events != MAP_FAILED) {
+            write_trace(events, raw_stat.st_size / sizeof(event_t));
+            munmap(events, raw_stat.st_size);
+        }
+    }
+    close(raw_fd);
+    unlink(raw_path);
+}
+
+/*
+ * stop_in_child - a forked child shares the raw file, so it leaves the
+ * recording to its parent unless it execs and starts one of its own.
+ */
+static void stop_in_child() {
+    __atomic_store_n(&recording, false, __ATOMIC_RELEASE);
+    close(raw_fd);
+}
+
+/*
+ * start_recording - opens the raw event file next to the trace and starts
+ * logging.
+ */
+__attribute__((constructor))
+static void start_recording() {
+    const char *path = getenv("UMALLOC_TRACE");
+    if (path && *path) {
+        snprintf(trace_path, sizeof(trace_path), "%s", path);
+    }
+    else {
+        snprintf(trace_path, sizeof(trace_path), "umalloc.%d.rep", getpid());
+    }
+    snprintf(raw_path, sizeof(raw_path), "%s.raw", trace_path);
+    raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (raw_fd < 0) {
+        fprintf(stderr, "recorder: could not open %s\n", raw_path);
+        return;
+    }
+    pthread_atfork(NULL, NULL, stop_in_child);
+    pthread_key_create(&log_key, log_destructor);
+    start_ns = now_ns();
+    __atomic_store_n(&recording, true, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,129 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * rep2bin.c - Converts a text trace (.rep) into the binary trace format,
+ * which runner and performance map and replay without parsing:
+ *
+ *     ./rep2bin traces/random.rep random.bin
+ *     ./performance random.bin
+ *
+ * With -d it prints the requests of a text or binary trace as a text trace
+ * instead, as runner and performance would replay them, and with -ds as
+ * performance -s streams them:
+ *
+ *     ./rep2bin -d random.bin > random.rep
+ **************************************************************************/
+
+#include "support.h"
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: rep2bin [-hv] in.rep out\n");
+    fprintf(stderr, "       rep2bin -d [-s] in\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-d         Print the trace in, text or binary, as a text trace.\n");
+    fprintf(stderr, "\t-s         Read the trace to print through the stream performance -s replays.\n");
+    fprintf(stderr, "\t-v         Print the size of the converted trace.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+/*
+ * print_op - Print a request as a line of a text trace
+ */
+static void print_op(traceop_t op) {
+    if (op.type == FREE) {
+        printf("f %d\n", op.index);
+    }
+    else {
+        printf("%c %d %d\n", op.type == ALLOC ? 'a' : 'r', op.index, op.size);
+    }
+}
+
+/*
+ * print_trace - Print the header and requests of trace in the text format
+ */
+static void print_trace(trace_t *trace) {
+    printf("%d\n%d\n", trace->num_ids, trace->num_ops);
+    for (int i = 0; i < trace->num_ops; i++) {
+        print_op(trace_op(trace, i));
+    }
+}
+
+/*
+ * print_stream - Print a streamed trace in the text format, a window at a time
+ */
+static void print_stream(trace_stream_t *stream) {
+    const trace_record_t *records;
+    size_t count;
+    int num_ids, num_ops;
+
+    trace_stream_counts(stream, &num_ids, &num_ops);
+    printf("%d\n%d\n", num_ids, num_ops);
+    while ((count = next_window(stream, &records))) {
+        for (size_t i = 0; i < count; i++) {
+            print_op(decode_op(records[i]));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int verbose = 0;
+    int dump = 0;
+    int stream = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "dhsv")) != -1) {
+        switch (c) {
+        case 'd':
+            dump = 1;
+            break;
+        case 's':
+            stream = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (stream && !dump) {
+        usage();
+        appl_error("Only a trace printed with -d can be streamed.");
+    }
+    if (dump) {
+        if (argc - optind != 1) {
+            usage();
+            appl_error("Expected an input file.");
+        }
+        if (stream) {
+            trace_stream_t *trace = open_trace_stream(argv[optind], 0);
+            print_stream(trace);
+            close_trace_stream(trace);
+        }
+        else {
+            trace_t *trace = read_trace(argv[optind], 0);
+            print_trace(trace);
+            free_trace(trace);
+        }
+        return 0;
+    }
+    if (argc - optind != 2) {
+        usage();
+        appl_error("Expected an input and an output file.");
+    }
+    trace_t *trace = read_trace(argv[optind], verbose);
+    write_binary_trace(trace, argv[optind + 1]);
+    if (verbose) {
+        printf("%d ops, %d ids, %zu bytes\n", trace->num_ops, trace->num_ids,
+               sizeof(trace_header_t) + trace->num_ops * sizeof(trace_record_t));
+    }
+    free_trace(trace);
+    return 0;
+}
@@ -14,7 +14,7 @@
 #include <sys/mman.h>
 
 int verbose = 0;
-char msg[MAXLINE];      /* for whenever we need to compose an error message */
+extern char msg[MAXLINE]; /* defined in support.c */
 extern size_t sbrk_bytes;
 extern const char author[];
 
@@ -87,20 +87,47 @@ static int check_correctness(trace_t *trace, size_t curr_op) {
 
 size_t curr_bytes_in_use;
 size_t max_bytes_in_use;
+size_t curr_mmap_bytes;  /* bytes of pages spanned by blocks mapped on their own */
+size_t max_footprint;    /* most bytes requested from sbrk and mapped at once */
 
 /* 
  * UTILIZATION_SCORE - the utilization score represents how well the umalloc
- * package uses the bytes requested from sbrk. For example, if 100 bytes are
- * requested from sbrk, and the user requested 80 bytes, there will be a 
- * utilization score of 80%.
+ * package uses the bytes requested from sbrk, and mapped for large blocks.
+ * For example, if 100 bytes are requested from sbrk, and the user requested
+ * 80 bytes, there will be a utilization score of 80%.
  */
-#define UTILIZATION_SCORE 100.0 * max_bytes_in_use / sbrk_bytes
+#define UTILIZATION_SCORE 100.0 * max_bytes_in_use / max_footprint
+
+/*
+ * check_bounds - Checks the payload rests within the sbrk range or, for the
+ * large blocks umalloc maps on their own, within pages that are mapped and
+ * whose header says so. Sets mapped to the bytes of the pages such a block
+ * spans, 0 for blocks in the sbrk range.
+ */
+static int check_bounds(void *payload, size_t size, size_t *mapped) {
+    *mapped = 0;
+    if (check_malloc_output(payload, size) == 0) {
+        return 0;
+    }
+    memory_block_t *block = get_block(payload);
+    uintptr_t start = (uintptr_t) block & ~((uintptr_t) PAGESIZE - 1);
+    uintptr_t end = ((uintptr_t) payload + size + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1);
+    /* msync fails with ENOMEM if any of the pages is not mapped */
+    if (msync((void *) start, end - start, MS_ASYNC) == -1) {
+        return -1;
+    }
+    if (!is_mmapped(block) || get_size(block) < size) {
+        return -1;
+    }
+    *mapped = end - start;
+    return 0;
+}
 
 /* 
  * run_trace_line - Runs a single line in the trace. Checking if all the 
  * correctness checks are still satisfied after the check. Checks if the returned
  * payload is aligned to 16 bytes, hasn't affected any other blocks, and rests
- * within the sbrk range. Runs the user created check heap function and prints
+ * within the sbrk range or a mapping of its own. Runs the user created check heap function and prints
  * the current utilization score if requested. 
  */
 static int run_trace_line(trace_t *trace, size_t curr_op, int utilization, int run_check_heap) {
@@ -109,7 +136,7 @@ static int run_trace_line(trace_t *trace, size_t curr_op, int utilization, int r
         void *ret = sbrk(4096);
         mprotect(ret, 4096, PROT_NONE);
     }
-    traceop_t op = trace->ops[curr_op];
+    traceop_t op = trace_op(trace, curr_op);
     if (op.type == ALLOC) {
         trace->blocks[op.index].is_allocated = true;
         trace->blocks[op.index].content_val = curr_op;
@@ -131,12 +158,52 @@ static int run_trace_line(trace_t *trace, size_t curr_op, int utilization, int r
             return -1;
         }
 
-        if(check_malloc_output(trace->blocks[op.index].payload, trace->blocks[op.index].block_size) == -1) {
+        if(check_bounds(trace->blocks[op.index].payload, trace->blocks[op.index].block_size, &trace->blocks[op.index].mapped_bytes) == -1) {
             printf("line %ld: umalloc allocated a block out of bounds.\n", LINENUM(curr_op));
             return -1;
         }
+        curr_mmap_bytes += trace->blocks[op.index].mapped_bytes;
 
         copy_id((size_t*) trace->blocks[op.index].payload, trace->blocks[op.index].block_size, curr_op);
+    } else if (op.type == REALLOC) {
+        allocated_block_t *block = &trace->blocks[op.index];
+        size_t kept = block->is_allocated ? (block->block_size < op.size ? block->block_size : op.size) : 0;
+
+        if (verbose) {
+            printf("line %ld: urealloc: id %d, Reallocating to %d bytes\n", LINENUM(curr_op), op.index, op.size);
+        }
+
+        void *payload = urealloc(block->is_allocated ? block->payload : NULL, op.size);
+        if (payload == NULL) {
+            malloc_error(curr_op, "urealloc failed.");
+            return -1;
+        }
+
+        if (((size_t) payload) % ALIGNMENT != 0) {
+            malloc_error(curr_op, "urealloc returned an unaligned payload.");
+            return -1;
+        }
+
+        size_t mapped;
+        if(check_bounds(payload, op.size, &mapped) == -1) {
+            printf("line %ld: urealloc allocated a block out of bounds.\n", LINENUM(curr_op));
+            return -1;
+        }
+
+        // the contents up to the smaller of the two sizes must come along
+        if (check_id((size_t*) payload, kept, block->content_val) == -1) {
+            malloc_error(curr_op, "urealloc lost the contents of the block.");
+            return -1;
+        }
+
+        curr_bytes_in_use += op.size - (block->is_allocated ? block->block_size : 0);
+        curr_mmap_bytes += mapped - (block->is_allocated ? block->mapped_bytes : 0);
+        block->mapped_bytes = mapped;
+        block->is_allocated = true;
+        block->payload = payload;
+        block->block_size = op.size;
+        block->content_val = curr_op;
+        copy_id((size_t*) payload, op.size, curr_op);
     } else {
         trace->blocks[op.index].is_allocated = false;
 
@@ -146,11 +213,15 @@ static int run_trace_line(trace_t *trace, size_t curr_op, int utilization, int r
 
         ufree(trace->blocks[op.index].payload);
         curr_bytes_in_use -= trace->blocks[op.index].block_size;
+        curr_mmap_bytes -= trace->blocks[op.index].mapped_bytes;
     }
 
     if (curr_bytes_in_use > max_bytes_in_use) {
         max_bytes_in_use = curr_bytes_in_use;
     }
+    if (sbrk_bytes + curr_mmap_bytes > max_footprint) {
+        max_footprint = sbrk_bytes + curr_mmap_bytes;
+    }
 
     if (run_check_heap) {
         if (check_heap() != 0) {
@@ -361,6 +432,8 @@ int main(int argc, char **argv)
     }
     curr_bytes_in_use = 0;
     max_bytes_in_use = 0;
+    curr_mmap_bytes = 0;
+    max_footprint = sbrk_bytes;
     if (autorun) {
         auto_run_trace(trace, display_utilization, run_check_heap, 0);
     } else {
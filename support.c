@@ -9,6 +9,31 @@
 
 #include "support.h"
 #include "err_handler.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define LIVE_MAP_EMPTY UINT32_MAX /* id of an unused live map slot */
+#define LIVE_MAP_MIN_BITS 10 /* a live map starts with 1 << LIVE_MAP_MIN_BITS slots */
+
+/* Replays a trace file a window of records at a time, see open_trace_stream */
+struct trace_stream {
+    FILE *tracefile;
+    char *filename;
+    bool binary;                         /* binary trace, else text */
+    int num_ids;                         /* counts from the trace's header */
+    int num_ops;
+    size_t read_ops;                     /* records the reader has filled in so far */
+    uint64_t sums[2];                    /* running checksum of a binary trace */
+    trace_record_t *windows[2];          /* one is replayed while the other is filled */
+    size_t counts[2];                    /* records in each window, 0 at the end */
+    bool ready[2];                       /* window is filled and not yet replayed */
+    int current;                         /* window being replayed, -1 before the first */
+    bool closing;                        /* tells the reader to stop */
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;              /* signalled whenever ready or closing changes */
+};
 
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
@@ -34,20 +59,177 @@ void malloc_error(int opnum, char *msg)
 }
 
 /*
- * read_trace - read a trace file and store it in memory
+ * encode_op - Packs a request into its record
+ */
+static trace_record_t encode_op(int type, unsigned index, unsigned size)
+{
+    trace_record_t record = { (unsigned) type << RECORD_TYPE_SHIFT | index, size };
+    return record;
+}
+
+/*
+ * read_text_header - read the id and op counts a text trace starts with
+ */
+static void read_text_header(FILE *tracefile, char *filename, int *num_ids, int *num_ops)
+{
+    int err;
+
+    err = fscanf(tracefile, "%d", num_ids); 
+    if (err == EOF) {
+        appl_error("fscanf failed to find num ids.");
+    }
+
+    err = fscanf(tracefile, "%d", num_ops); 
+    if (err == EOF) {
+        appl_error("fscanf failed to find num ops.");
+    }    
+    if (*num_ids < 0 || *num_ids > RECORD_INDEX_MASK + 1 || *num_ops < 0) {
+        sprintf(msg, "Bad id or op count in tracefile %s", filename);
+        appl_error(msg);
+    }
+}
+
+/*
+ * read_text_op - read the next request line of a text trace into record.
+ * Besides allocations (a id size) and frees (f id) a trace may reallocate the
+ * block of an id to a new size (r id size), and fields after those on a line,
+ * such as the thread and timestamp recorded by the trace recorder, are skipped.
+ * Returns false at the end of the file.
+ */
+static bool read_text_op(FILE *tracefile, char *filename, trace_record_t *record)
+{
+    char type[MAXLINE];
+    unsigned index = 0;
+    unsigned size = 0;
+    int err;
+
+    if (fscanf(tracefile, "%s", type) == EOF)
+        return false;
+    switch(type[0]) {
+    case 'a':
+        err = fscanf(tracefile, "%u %u", &index, &size);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index and size.");
+        }
+        *record = encode_op(ALLOC, index, size);
+        break;
+    case 'r':
+        err = fscanf(tracefile, "%u %u", &index, &size);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index and size.");
+        }
+        *record = encode_op(REALLOC, index, size);
+        break;
+    case 'f':
+        err = fscanf(tracefile, "%ud", &index);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index.");
+        }
+        *record = encode_op(FREE, index, 0);
+    break;
+    default:
+        sprintf(msg, "Bogus type character (%c) in tracefile %s\n", type[0], filename);
+        appl_error(msg);
+    }
+    if (index > RECORD_INDEX_MASK) {
+        sprintf(msg, "Id %u out of range in tracefile %s", index, filename);
+        appl_error(msg);
+    }
+    err = fscanf(tracefile, "%*[^\n]");
+    return true;
+}
+
+/*
+ * read_text_trace - read the requests of a text trace into a records array.
+ */
+static void read_text_trace(trace_t *trace, FILE *tracefile, char *filename)
+{
+    read_text_header(tracefile, filename, &trace->num_ids, &trace->num_ops);
+    
+    /* We'll store each request line in the trace in this array */
+    trace_record_t *records = (trace_record_t *)calloc(trace->num_ops, sizeof(trace_record_t));
+    if (records == NULL)
+        appl_error("Failed to allocate op array");
+
+    /* read every request line in the trace file */
+    trace_record_t record;
+    unsigned op_index = 0;
+    unsigned max_index = 0;
+    while (read_text_op(tracefile, filename, &record)) {
+        if (op_index == trace->num_ops) {
+            sprintf(msg, "More ops than the header of tracefile %s says", filename);
+            appl_error(msg);
+        }
+        if (record.index >> RECORD_TYPE_SHIFT == ALLOC) {
+            unsigned index = record.index & RECORD_INDEX_MASK;
+            max_index = (index > max_index) ? index : max_index;
+        }
+        records[op_index++] = record;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+    trace->records = records;
+}
+
+/*
+ * map_binary_trace - maps a binary trace file and points the trace's records
+ * at it, after checking its size, checksum and ids.
+ */
+static void map_binary_trace(trace_t *trace, FILE *tracefile, char *filename)
+{
+    struct stat st;
+    if (fstat(fileno(tracefile), &st) == -1 || st.st_size < sizeof(trace_header_t)) {
+        sprintf(msg, "Truncated binary tracefile %s", filename);
+        appl_error(msg);
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(tracefile), 0);
+    if (mapping == MAP_FAILED) {
+        sprintf(msg, "Could not map %s in read_trace", filename);
+        appl_error(msg);
+    }
+    madvise(mapping, st.st_size, MADV_WILLNEED);
+
+    const trace_header_t *header = mapping;
+    const trace_record_t *records = (const trace_record_t *) (header + 1);
+    if (header->num_ids > RECORD_INDEX_MASK + 1 || header->num_ops > INT32_MAX ||
+        st.st_size != sizeof(trace_header_t) + (size_t) header->num_ops * sizeof(trace_record_t)) {
+        sprintf(msg, "Binary tracefile %s does not match its header", filename);
+        appl_error(msg);
+    }
+    if (trace_checksum(records, header->num_ops) != header->checksum) {
+        sprintf(msg, "Checksum mismatch in binary tracefile %s", filename);
+        appl_error(msg);
+    }
+    for (size_t i = 0; i < header->num_ops; i++) {
+        if ((records[i].index & RECORD_INDEX_MASK) >= header->num_ids || records[i].index >> RECORD_TYPE_SHIFT > REALLOC) {
+            sprintf(msg, "Bad request %zu in binary tracefile %s", i, filename);
+            appl_error(msg);
+        }
+    }
+
+    trace->num_ids = header->num_ids;
+    trace->num_ops = header->num_ops;
+    trace->records = records;
+    trace->mapping = mapping;
+    trace->mapping_size = st.st_size;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. Text traces are
+ * parsed into a records array, binary ones (see write_binary_trace) are
+ * mapped and replayed in place.
  */
 trace_t *read_trace(char *filename, int verbose)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
-    int err;
+    char magic[sizeof(TRACE_MAGIC) - 1];
 
     if (verbose)
         printf("Reading tracefile: %s\n", filename);
 
     /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+    if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
         appl_error("malloc 1 failed in read_trace");
 
     /* Read the trace file header */
@@ -56,73 +238,389 @@ trace_t *read_trace(char *filename, int verbose)
         appl_error(msg);
     }
 
-    err = fscanf(tracefile, "%d", &(trace->num_ids)); 
-    if (err == EOF) {
-        appl_error("fscanf failed to find num ids.");
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) && !memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+        map_binary_trace(trace, tracefile, filename);
     }
-
-    err = fscanf(tracefile, "%d", &(trace->num_ops)); 
-    if (err == EOF) {
-        appl_error("fscanf failed to find num ops.");
-    }    
-    
-    /* We'll store each request line in the trace in this array */
-    trace->ops = (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t));
-    if (trace->ops == NULL)
-        appl_error("Failed to allocate op array");
+    else {
+        rewind(tracefile);
+        read_text_trace(trace, tracefile, filename);
+    }
+    fclose(tracefile);
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     trace->blocks = (allocated_block_t *)calloc(trace->num_ids, sizeof(allocated_block_t));
     if (trace->blocks == NULL)
         appl_error("Failed to allocate block array");
 
-    
-    /* read every request line in the trace file */
-    unsigned index = 0;
-    unsigned op_index = 0;
-    unsigned max_index = 0;
-    unsigned size = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
-        case 'a':
-            err = fscanf(tracefile, "%u %u", &index, &size);
-            if (err == EOF) {
-                appl_error("fscanf failed to find index and size.");
-            }
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            err = fscanf(tracefile, "%ud", &index);
-            if (err == EOF) {
-                appl_error("fscanf failed to find index.");
-            }
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-        break;
-        default:
-            sprintf(msg, "Bogus type character (%c) in tracefile %s\n", type[0], filename);
-            appl_error(msg);
-        }
-        op_index++;
+    return trace;
+}
 
+/*
+ * add_to_checksum - Fletcher style running sums over the records of a binary
+ * trace, which catch both flipped bits and reordered records. sums starts
+ * out zero and may be carried from one run of records to the next.
+ */
+static void add_to_checksum(uint64_t sums[2], const trace_record_t *records, size_t num_records)
+{
+    uint64_t sum = sums[0], sum_of_sums = sums[1];
+    for (size_t i = 0; i < num_records; i++) {
+        sum += (uint64_t) records[i].size << 32 | records[i].index;
+        sum_of_sums += sum;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
+    sums[0] = sum;
+    sums[1] = sum_of_sums;
+}
 
-    return trace;
+static uint64_t finish_checksum(uint64_t sums[2])
+{
+    return sums[0] ^ (sums[1] << 32 | sums[1] >> 32);
+}
+
+/*
+ * trace_checksum - The checksum a binary trace's header holds for its records
+ */
+uint64_t trace_checksum(const trace_record_t *records, size_t num_records)
+{
+    uint64_t sums[2] = { 0, 0 };
+    add_to_checksum(sums, records, num_records);
+    return finish_checksum(sums);
+}
+
+/*
+ * write_binary_trace - Writes the trace out as a binary trace file: a
+ * trace_header_t followed by the trace's records as they are in memory.
+ */
+void write_binary_trace(trace_t *trace, char *filename)
+{
+    FILE *tracefile;
+    trace_header_t header;
+
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.num_ids = trace->num_ids;
+    header.num_ops = trace->num_ops;
+    header.checksum = trace_checksum(trace->records, trace->num_ops);
+
+    if ((tracefile = fopen(filename, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_binary_trace", filename);
+        appl_error(msg);
+    }
+    if (fwrite(&header, sizeof(header), 1, tracefile) != 1 ||
+        fwrite(trace->records, sizeof(trace_record_t), trace->num_ops, tracefile) != trace->num_ops ||
+        fclose(tracefile) == EOF) {
+        sprintf(msg, "Could not write %s in write_binary_trace", filename);
+        appl_error(msg);
+    }
 }
 
 /*
  * free_trace - Free the trace record and the two arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(), or
+ *              unmap the file a binary trace's records are in.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the two arrays... */
+    if (trace->mapping)
+        munmap(trace->mapping, trace->mapping_size);
+    else
+        free((void *) trace->records); /* free the two arrays... */
     free(trace->blocks);      
     free(trace);              /* and the trace record itself... */
-}
\ No newline at end of file
+}
+
+/*
+ * fill_window - reads the next records of a stream's trace into window,
+ * checking them like read_trace() does. Returns how many it read, 0 once
+ * the trace is over.
+ */
+static size_t fill_window(trace_stream_t *stream, trace_record_t *window)
+{
+    size_t left = stream->num_ops - stream->read_ops;
+    size_t count = 0;
+
+    if (stream->binary) {
+        size_t want = left < STREAM_WINDOW ? left : STREAM_WINDOW;
+        count = fread(window, sizeof(trace_record_t), want, stream->tracefile);
+        if (count < want) {
+            sprintf(msg, "Truncated binary tracefile %s", stream->filename);
+            appl_error(msg);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if ((window[i].index & RECORD_INDEX_MASK) >= stream->num_ids || window[i].index >> RECORD_TYPE_SHIFT > REALLOC) {
+                sprintf(msg, "Bad request %zu in binary tracefile %s", stream->read_ops + i, stream->filename);
+                appl_error(msg);
+            }
+        }
+        add_to_checksum(stream->sums, window, count);
+        stream->read_ops += count;
+        if (stream->read_ops == stream->num_ops && count < STREAM_WINDOW) {
+            trace_header_t header;
+            rewind(stream->tracefile);
+            if (fread(&header, sizeof(header), 1, stream->tracefile) != 1 || header.checksum != finish_checksum(stream->sums)) {
+                sprintf(msg, "Checksum mismatch in binary tracefile %s", stream->filename);
+                appl_error(msg);
+            }
+        }
+        return count;
+    }
+
+    while (count < STREAM_WINDOW && read_text_op(stream->tracefile, stream->filename, &window[count])) {
+        if (count == left) {
+            sprintf(msg, "More ops than the header of tracefile %s says", stream->filename);
+            appl_error(msg);
+        }
+        count++;
+    }
+    stream->read_ops += count;
+    if (count < STREAM_WINDOW && stream->read_ops != stream->num_ops) {
+        sprintf(msg, "Fewer ops than the header of tracefile %s says", stream->filename);
+        appl_error(msg);
+    }
+    return count;
+}
+
+/*
+ * stream_reader - fills the stream's two windows in turn, each as soon as
+ * the replay has moved off it, until the trace is over or the stream closes.
+ */
+static void *stream_reader(void *arg)
+{
+    trace_stream_t *stream = arg;
+    for (int window = 0; ; window ^= 1) {
+        pthread_mutex_lock(&stream->lock);
+        while (stream->ready[window] && !stream->closing)
+            pthread_cond_wait(&stream->changed, &stream->lock);
+        bool closing = stream->closing;
+        pthread_mutex_unlock(&stream->lock);
+        if (closing)
+            return NULL;
+
+        size_t count = fill_window(stream, stream->windows[window]);
+
+        pthread_mutex_lock(&stream->lock);
+        stream->counts[window] = count;
+        stream->ready[window] = true;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+        if (!count)
+            return NULL;
+    }
+}
+
+/*
+ * open_trace_stream - opens a text or binary trace for replay in windows of
+ * STREAM_WINDOW records. A reader thread parses or reads the next window
+ * while the current one is replayed, so memory does not grow with the
+ * length of the trace.
+ */
+trace_stream_t *open_trace_stream(char *filename, int verbose)
+{
+    trace_stream_t *stream;
+    char magic[sizeof(TRACE_MAGIC) - 1];
+
+    if (verbose)
+        printf("Streaming tracefile: %s\n", filename);
+
+    if ((stream = (trace_stream_t *) calloc(1, sizeof(trace_stream_t))) == NULL)
+        appl_error("malloc failed in open_trace_stream");
+    if ((stream->tracefile = fopen(filename, "r")) == NULL) {
+        sprintf(msg, "Could not open %s in open_trace_stream", filename);
+        appl_error(msg);
+    }
+    stream->filename = filename;
+
+    if (fread(magic, 1, sizeof(magic), stream->tracefile) == sizeof(magic) && !memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+        trace_header_t header;
+        rewind(stream->tracefile);
+        if (fread(&header, sizeof(header), 1, stream->tracefile) != 1 ||
+            header.num_ids > RECORD_INDEX_MASK + 1 || header.num_ops > INT32_MAX) {
+            sprintf(msg, "Bad header in binary tracefile %s", filename);
+            appl_error(msg);
+        }
+        stream->binary = true;
+        stream->num_ids = header.num_ids;
+        stream->num_ops = header.num_ops;
+    }
+    else {
+        rewind(stream->tracefile);
+        read_text_header(stream->tracefile, filename, &stream->num_ids, &stream->num_ops);
+    }
+
+    for (int window = 0; window < 2; window++) {
+        if ((stream->windows[window] = (trace_record_t *) malloc(STREAM_WINDOW * sizeof(trace_record_t))) == NULL)
+            appl_error("Failed to allocate stream window");
+    }
+    stream->current = -1;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    if (pthread_create(&stream->reader, NULL, stream_reader, stream) != 0)
+        appl_error("Failed to start the stream reader");
+    return stream;
+}
+
+/*
+ * next_window - hands the window the replay is done with back to the reader
+ * and points records at the next one, waiting for it to be filled. Returns
+ * the number of records in it, 0 once the trace is over.
+ */
+size_t next_window(trace_stream_t *stream, const trace_record_t **records)
+{
+    pthread_mutex_lock(&stream->lock);
+    if (stream->current >= 0) {
+        stream->ready[stream->current] = false;
+        pthread_cond_broadcast(&stream->changed);
+    }
+    stream->current = stream->current < 0 ? 0 : stream->current ^ 1;
+    while (!stream->ready[stream->current])
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    size_t count = stream->counts[stream->current];
+    pthread_mutex_unlock(&stream->lock);
+
+    *records = stream->windows[stream->current];
+    return count;
+}
+
+/*
+ * trace_stream_counts - reports the number of ids and of requests the header
+ * of the streamed trace gives
+ */
+void trace_stream_counts(trace_stream_t *stream, int *num_ids, int *num_ops)
+{
+    *num_ids = stream->num_ids;
+    *num_ops = stream->num_ops;
+}
+
+/*
+ * close_trace_stream - stops the reader, which may still be ahead of the
+ * replay, and frees the stream
+ */
+void close_trace_stream(trace_stream_t *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->closing = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    free(stream->windows[0]);
+    free(stream->windows[1]);
+    fclose(stream->tracefile);
+    free(stream);
+}
+
+/*
+ * live_map_home - the slot an id hashes to, Fibonacci hashing spreads the
+ * dense ids of a trace over the whole table
+ */
+static inline size_t live_map_home(live_map_t *map, uint32_t id)
+{
+    return (id * 11400714819323198485ull) >> (64 - map->bits);
+}
+
+/*
+ * live_map_slot - the slot holding id, or the empty slot its probe ends at
+ */
+static live_block_t *live_map_slot(live_map_t *map, uint32_t id)
+{
+    size_t mask = ((size_t) 1 << map->bits) - 1;
+    size_t slot = live_map_home(map, id);
+    while (map->slots[slot].id != id && map->slots[slot].id != LIVE_MAP_EMPTY)
+        slot = (slot + 1) & mask;
+    return &map->slots[slot];
+}
+
+static void live_map_alloc(live_map_t *map, int bits)
+{
+    size_t capacity = (size_t) 1 << bits;
+    if ((map->slots = (live_block_t *) malloc(capacity * sizeof(live_block_t))) == NULL)
+        appl_error("Failed to allocate live map");
+    for (size_t slot = 0; slot < capacity; slot++)
+        map->slots[slot].id = LIVE_MAP_EMPTY;
+    map->bits = bits;
+}
+
+/*
+ * live_map_resize - Moves every entry into a new table of 1 << bits slots
+ */
+static void live_map_resize(live_map_t *map, int bits)
+{
+    live_block_t *old_slots = map->slots;
+    size_t old_capacity = (size_t) 1 << map->bits;
+    live_map_alloc(map, bits);
+    for (size_t slot = 0; slot < old_capacity; slot++) {
+        if (old_slots[slot].id != LIVE_MAP_EMPTY)
+            *live_map_slot(map, old_slots[slot].id) = old_slots[slot];
+    }
+    free(old_slots);
+}
+
+/*
+ * live_map_init - Starts an empty map from trace ids to the payloads of
+ * their live blocks. It is open addressed with linear probing, grows so
+ * that at most half its slots are in use and shrinks once fewer than an
+ * eighth are, so a trace that frees most of its blocks gives the room back.
+ */
+void live_map_init(live_map_t *map)
+{
+    live_map_alloc(map, LIVE_MAP_MIN_BITS);
+    map->count = 0;
+}
+
+/*
+ * live_map_find - Returns the entry of id, or NULL when its block is not live
+ */
+live_block_t *live_map_find(live_map_t *map, uint32_t id)
+{
+    live_block_t *block = live_map_slot(map, id);
+    return block->id == id ? block : NULL;
+}
+
+/*
+ * live_map_insert - Returns the entry of id, adding one with a NULL payload
+ * if there is none. Entries move when the map grows or shrinks, so the
+ * pointer is only good until the next insert or remove.
+ */
+live_block_t *live_map_insert(live_map_t *map, uint32_t id)
+{
+    if ((map->count + 1) * 2 > (size_t) 1 << map->bits)
+        live_map_resize(map, map->bits + 1);
+    live_block_t *block = live_map_slot(map, id);
+    if (block->id == LIVE_MAP_EMPTY) {
+        block->id = id;
+        block->payload = NULL;
+        map->count++;
+    }
+    return block;
+}
+
+/*
+ * live_map_remove - Removes an entry found by live_map_find or
+ * live_map_insert, moving later entries of its probe run back so that
+ * lookups never need tombstones. Entries move when the map shrinks.
+ */
+void live_map_remove(live_map_t *map, live_block_t *block)
+{
+    size_t mask = ((size_t) 1 << map->bits) - 1;
+    size_t hole = block - map->slots;
+    for (size_t slot = (hole + 1) & mask; map->slots[slot].id != LIVE_MAP_EMPTY; slot = (slot + 1) & mask) {
+        size_t home = live_map_home(map, map->slots[slot].id);
+        /* the entry may fill the hole if its home is not after the hole along its probe */
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            map->slots[hole] = map->slots[slot];
+            hole = slot;
+        }
+    }
+    map->slots[hole].id = LIVE_MAP_EMPTY;
+    map->count--;
+    /* halving leaves a quarter in use, so alternating inserts and removes never resize back and forth */
+    if (map->bits > LIVE_MAP_MIN_BITS && map->count * 8 < (size_t) 1 << map->bits)
+        live_map_resize(map, map->bits - 1);
+}
+
+void live_map_destroy(live_map_t *map)
+{
+    free(map->slots);
+    map->slots = NULL;
+    map->count = 0;
+}
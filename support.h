@@ -21,32 +21,97 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       2 /* number of header lines in a trace file */
 #define LINENUM(i) (i+ 1 + HDRLINES) /* cnvt trace request nums to linenums (origin 1) */
+#define TRACE_MAGIC "UMTRACE1" /* first bytes of a binary trace file */
+#define RECORD_TYPE_SHIFT 30 /* bits of a record's index word below its type */
+#define RECORD_INDEX_MASK ((1u << RECORD_TYPE_SHIFT) - 1)
+#define STREAM_WINDOW 65536 /* records in each of a trace stream's two windows */
 
 /* Represents an allocated block returned by umalloc */
 typedef struct {
     void *payload;
     size_t block_size;
     size_t content_val; 
+    size_t mapped_bytes; /* pages spanned outside the sbrk range, 0 within it */
     bool is_allocated;
 } allocated_block_t;
 
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc request */
+    int size;                         /* byte size of alloc or realloc request */
 } traceop_t;
 
+/* One request as stored in memory and in binary trace files */
+typedef struct {
+    uint32_t index;      /* type << RECORD_TYPE_SHIFT | id */
+    uint32_t size;       /* byte size of alloc or realloc request */
+} trace_record_t;
+
+/* Starts a binary trace file, num_ops trace_record_t follow it */
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC */
+    uint32_t num_ids;    /* number of alloc ids */
+    uint32_t num_ops;    /* number of records */
+    uint64_t checksum;   /* trace_checksum() of the records */
+} trace_header_t;
+
 /* Holds the information for one trace file*/
 typedef struct {
     int num_ids;         /* number of alloc ids */
     int num_ops;         /* number of distinct requests */
-    traceop_t *ops;      /* array of requests */
+    const trace_record_t *records; /* array of requests */
     allocated_block_t *blocks; /* array of blocks returned by umalloc */
+    void *mapping;       /* the mapped file of a binary trace, records point into it */
+    size_t mapping_size;
 } trace_t;
 
+/* Replays a trace file a window at a time, opaque outside support.c */
+typedef struct trace_stream trace_stream_t;
+
+/* The block of a live id while a trace is streamed */
+typedef struct {
+    void *payload;
+    uint32_t id;         /* trace id of the block */
+} live_block_t;
+
+/* Maps the ids of a streamed trace's live blocks to their payloads */
+typedef struct {
+    live_block_t *slots; /* 1 << bits slots, open addressed */
+    int bits;
+    size_t count;        /* number of live blocks */
+} live_map_t;
+
+/*
+ * decode_op - Unpacks a request from its record
+ */
+static inline traceop_t decode_op(trace_record_t record)
+{
+    traceop_t op = { record.index >> RECORD_TYPE_SHIFT, record.index & RECORD_INDEX_MASK, record.size };
+    return op;
+}
+
+/*
+ * trace_op - Decodes request i of the trace
+ */
+static inline traceop_t trace_op(const trace_t *trace, size_t i)
+{
+    return decode_op(trace->records[i]);
+}
+
 void appl_error(char *msg);
 void malloc_error(int opnum, char *msg);
 trace_t *read_trace(char *filename, int verbose);
-void free_trace(trace_t *trace);
\ No newline at end of file
+void write_binary_trace(trace_t *trace, char *filename);
+uint64_t trace_checksum(const trace_record_t *records, size_t num_records);
+void free_trace(trace_t *trace);
+trace_stream_t *open_trace_stream(char *filename, int verbose);
+size_t next_window(trace_stream_t *stream, const trace_record_t **records);
+void trace_stream_counts(trace_stream_t *stream, int *num_ids, int *num_ops);
+void close_trace_stream(trace_stream_t *stream);
+void live_map_init(live_map_t *map);
+live_block_t *live_map_find(live_map_t *map, uint32_t id);
+live_block_t *live_map_insert(live_map_t *map, uint32_t id);
+void live_map_remove(live_map_t *map, live_block_t *block);
+void live_map_destroy(live_map_t *map);
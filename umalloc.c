@@ -1,8 +1,13 @@
+#define _GNU_SOURCE // mremap
 #include "umalloc.h"
 #include "csbrk.h"
 #include "ansicolors.h"
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <errno.h>
 
 const char author[] = ANSI_BOLD ANSI_COLOR_RED "MAX FELDMAN:mdf2627" ANSI_RESET;
 
@@ -11,15 +16,217 @@ const char author[] = ANSI_BOLD ANSI_COLOR_RED "MAX FELDMAN:mdf2627" ANSI_RESET;
  * struct, they can be adjusted as necessary.
  */
 
-// A sample pointer to the start of the free list.
-memory_block_t *free_head;
+// The arenas, each with its own lock and one LIFO free list per size class.
+arena_t arenas[MAX_ARENAS] = { [0 ... MAX_ARENAS-1] = { .lock = PTHREAD_MUTEX_INITIALIZER } };
+size_t num_arenas = 1; // raised once a second thread shows up
+static size_t next_arena;
+static pthread_once_t num_arenas_once = PTHREAD_ONCE_INIT;
+static pthread_once_t fork_handlers_once = PTHREAD_ONCE_INIT;
+static __thread arena_t *thread_arena;
+
+// csbrk moves the one program break every arena grows from.
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * pagemap_leaf_t - one bit per SLAB_SIZE page telling whether a slab starts
+ * there, for 1 << PAGEMAP_LEAF_SHIFT consecutive pages. Leaves are mmapped on
+ * demand so the bitmap never takes heap space, and are chained so uinit() can
+ * clear them.
+ */
+#define PAGEMAP_ADDRESS_BITS 48
+#define PAGEMAP_LEAF_SHIFT 18
+#define PAGEMAP_NUM_LEAVES (1 << (PAGEMAP_ADDRESS_BITS - SLAB_SHIFT - PAGEMAP_LEAF_SHIFT))
+
+typedef struct pagemap_leaf_struct {
+    struct pagemap_leaf_struct *next;
+    uint64_t bits[(1 << PAGEMAP_LEAF_SHIFT) / 64];
+} pagemap_leaf_t;
+
+static pagemap_leaf_t *pagemap[PAGEMAP_NUM_LEAVES];
+static pagemap_leaf_t *pagemap_leaves;
+static pthread_mutex_t pagemap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Requests from this size on are mmapped, well below the largest chunk csbrk hands out.
+#define DEFAULT_MMAP_THRESHOLD (PAGESIZE * 14)
+static size_t mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+// Free blocks from this size on release memory, with hysteresis as a trimmed top keeps half of it.
+#define DEFAULT_TRIM_THRESHOLD (PAGESIZE * 32)
+#define DECOMMIT_MIN (PAGESIZE * 4) /* Fewest bytes a free drops from the middle of a block, less is not worth the page faults */
+static size_t trim_threshold = DEFAULT_TRIM_THRESHOLD;
+static bool defer_coalescing;
+
+// Heap growth: arenas grow by a fraction of their size, doubled for every extension in a row, within [min_chunk, max_chunk].
+#define CSBRK_LIMIT 65536 /* Most bytes csbrk hands out per call */
+#define DEFAULT_INITIAL_HEAP (PAGESIZE * 8)
+#define DEFAULT_MIN_CHUNK (PAGESIZE * 4)
+#define DEFAULT_MAX_CHUNK CSBRK_LIMIT
+#define GROWTH_SHIFT 3 /* An arena grows by at least an eighth of its size */
+#define MAX_GROWTH_STREAK 4
+static size_t initial_heap = DEFAULT_INITIAL_HEAP;
+static size_t min_chunk = DEFAULT_MIN_CHUNK;
+static size_t max_chunk = DEFAULT_MAX_CHUNK;
+static umalloc_stats_t stats;
+
+/*
+ * tcache_t - a thread's private stacks of recently freed small payloads, one
+ * per slab class followed by one per exact block size class. Cached payloads
+ * stay allocated so neither their slab nor the heap reclaims them, and are
+ * chained through their first word.
+ */
+typedef struct {
+    void *entries[NUM_SMALL_CLASSES];
+    uint16_t counts[NUM_SMALL_CLASSES];
+} tcache_t;
+
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+/*
+ * thread_stats_t - a thread's share of the counters. Only the owning thread
+ * updates them, with relaxed atomic stores that compile to plain moves, so
+ * umalloc_stats() can sum the shares of the threads on thread_stats_list
+ * while they run. An exiting thread folds its share into retired_counters.
+ */
+typedef struct thread_stats_struct {
+    struct thread_stats_struct *prev;
+    struct thread_stats_struct *next;
+    bool registered;
+    umalloc_counters_t counters;
+} thread_stats_t;
+
+static __thread thread_stats_t thread_stats;
+static thread_stats_t *thread_stats_list;
+static umalloc_counters_t retired_counters;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define COUNT(counter, n) __atomic_store_n(&thread_stats.counters.counter, thread_stats.counters.counter + (n), __ATOMIC_RELAXED)
+
+/*
+ * tcache_destructor - hands an exiting thread's cached blocks back to the heap
+ * and retires its counters.
+ */
+static void tcache_destructor(void *unused) {
+    tcache_flush();
+    pthread_mutex_lock(&stats_lock);
+    size_t *from = (size_t *) &thread_stats.counters;
+    size_t *to = (size_t *) &retired_counters;
+    for (size_t i = 0; i < sizeof(umalloc_counters_t) / sizeof(size_t); i++) {
+        to[i] += from[i];
+    }
+    memset(&thread_stats.counters, 0, sizeof(thread_stats.counters));
+    if (thread_stats.prev) {
+        thread_stats.prev->next = thread_stats.next;
+    }
+    else {
+        thread_stats_list = thread_stats.next;
+    }
+    if (thread_stats.next) {
+        thread_stats.next->prev = thread_stats.prev;
+    }
+    thread_stats.registered = false;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void tcache_key_create() {
+    pthread_key_create(&tcache_key, tcache_destructor);
+}
+
+/*
+ * register_thread - runs on a thread's first cached free or counted call,
+ * making its counters visible to umalloc_stats() and registering the
+ * destructor that flushes its cache and retires its counters on exit.
+ */
+static __attribute__((noinline)) void register_thread() {
+    pthread_once(&tcache_key_once, tcache_key_create);
+    pthread_setspecific(tcache_key, &tcache);
+    pthread_mutex_lock(&stats_lock);
+    thread_stats.prev = NULL;
+    thread_stats.next = thread_stats_list;
+    if (thread_stats_list) {
+        thread_stats_list->prev = &thread_stats;
+    }
+    thread_stats_list = &thread_stats;
+    thread_stats.registered = true;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * count_alloc - counts an allocation of size requested bytes that handed out
+ * usable bytes.
+ */
+static inline void count_alloc(size_t size, size_t usable) {
+    if (__builtin_expect(!thread_stats.registered, 0)) {
+        register_thread();
+    }
+    COUNT(malloc_calls, 1);
+    COUNT(class_allocs[size < SMALL_CLASS_LIMIT ? size / ALIGNMENT : NUM_SIZE_CLASSES], 1);
+    COUNT(bytes_in_use, usable);
+}
+
+/*
+ * count_free - counts giving back an allocation of usable bytes. The share of
+ * bytes in use of a thread that frees what others allocated wraps around, the
+ * sum over all threads does not.
+ */
+static inline void count_free(size_t usable) {
+    if (__builtin_expect(!thread_stats.registered, 0)) {
+        register_thread();
+    }
+    COUNT(free_calls, 1);
+    COUNT(bytes_in_use, -usable);
+}
+
+/*
+ * count_resize - counts an allocation resized in place from old_usable to
+ * new_usable bytes.
+ */
+static void count_resize(size_t old_usable, size_t new_usable) {
+    if (__builtin_expect(!thread_stats.registered, 0)) {
+        register_thread();
+    }
+    COUNT(bytes_in_use, new_usable - old_usable);
+}
+
+/*
+ * count_search - counts a free list search that looked at length free blocks
+ * or tree nodes, in a power-of-two bucket.
+ */
+static void count_search(size_t length) {
+    size_t bucket = length ? 64 - __builtin_clzl(length) : 0;
+    COUNT(search_lengths[bucket < STATS_SEARCH_BUCKETS ? bucket : STATS_SEARCH_BUCKETS - 1], 1);
+}
 
 /*
  * is_allocated - returns true if a block is marked as allocated.
+ *
+ * An allocated block's header is read without the heap lock by ufree() while
+ * another thread may flip its preceeding-free bit under the lock, so the size
+ * and allocated bit are read atomically and that bit is updated atomically.
  */
 bool is_allocated(memory_block_t *block) {
     assert(block != NULL);
-    return block->block_size_alloc & 0x1;
+    return __atomic_load_n(&block->block_size_alloc, __ATOMIC_RELAXED) & 0x1;
+}
+
+bool is_mmapped(memory_block_t *block) {
+    assert(block != NULL);
+    return __atomic_load_n(&block->block_size_alloc, __ATOMIC_RELAXED) & MMAPPED_BIT;
+}
+
+bool is_zeroed(memory_block_t *block) {
+    assert(block != NULL);
+    return block->block_size_alloc & ZEROED_BIT;
+}
+
+void set_zeroed(memory_block_t *block, bool zeroed) {
+    assert(block != NULL);
+    if (zeroed) {
+        block->block_size_alloc |= ZEROED_BIT;
+    }
+    else {
+        block->block_size_alloc &= ~ZEROED_BIT;
+    }
 }
 
 bool has_preceeding(memory_block_t *block) {
@@ -32,18 +239,29 @@ bool has_proceeding(memory_block_t *block) {
     return (block->block_size_alloc>>2) & 0x1;
 }
 
+bool has_free_preceeding(memory_block_t *block) {
+    assert(block != NULL);
+    return (block->block_size_alloc>>3) & 0x1;
+}
+
+/*
+ * get_preceeding - reads the footer of the preceeding block, which only
+ * exists while that block is free.
+ */
 memory_block_t *get_preceeding(memory_block_t *block) {
-    if (!has_preceeding(block)) {
+    if (!has_preceeding(block) || !has_free_preceeding(block)) {
         return NULL;
     }
-    return block->prev_adjacent;
+    size_t footer = *(((size_t *) block) - 1);
+    size_t entire_size = footer & SIZE_MASK;
+    return (memory_block_t *) (((void *) block) - entire_size);
 }
 
 memory_block_t *get_proceeding(memory_block_t *block) {
     if (!has_proceeding(block)) {
         return NULL;
     }
-    void* ptr = get_payload(block) + get_size(block);
+    void* ptr = ((void *) block) + get_entire_size(block);
     return (memory_block_t *) ptr;
 }
 
@@ -83,10 +301,41 @@ void set_no_proceeding(memory_block_t *block) {
     block->block_size_alloc &= ~0x4;
 }
 
+void set_free_preceeding(memory_block_t *block) {
+    assert(block != NULL);
+    __atomic_or_fetch(&block->block_size_alloc, 0x8, __ATOMIC_RELAXED);
+}
+
+void set_allocated_preceeding(memory_block_t *block) {
+    assert(block != NULL);
+    __atomic_and_fetch(&block->block_size_alloc, ~0x8, __ATOMIC_RELAXED);
+}
+
+/*
+ * put_footer - writes the boundary tag of a free block and lets the proceeding
+ * block know its neighbor is free.
+ */
+void put_footer(memory_block_t *block) {
+    assert(!is_allocated(block));
+    size_t *footer = ((void *) block) + get_entire_size(block) - sizeof(size_t);
+    *footer = block->block_size_alloc;
+    if (has_proceeding(block)) {
+        set_free_preceeding(get_proceeding(block));
+    }
+    else if (!is_mmapped(block)) {
+        set_last_block(block);
+    }
+}
+
+/*
+ * set_size - sets the payload size of the block, the header records the
+ * entire size so the flag bits stay clear of it.
+ */
 void set_size(memory_block_t *block, size_t size) {
     assert(block != NULL);
-    block->block_size_alloc &= ALIGNMENT-1;
-    block->block_size_alloc = (size & ~(ALIGNMENT-1)) | block->block_size_alloc;
+    assert((size + HEADER_SIZE) % ALIGNMENT == 0);
+    block->block_size_alloc &= ~SIZE_MASK;
+    block->block_size_alloc = (size + HEADER_SIZE) | block->block_size_alloc;
 }
 
 /*
@@ -94,7 +343,90 @@ void set_size(memory_block_t *block, size_t size) {
  */
 size_t get_size(memory_block_t *block) {
     assert(block != NULL);
-    return block->block_size_alloc & ~(ALIGNMENT-1);
+    return (__atomic_load_n(&block->block_size_alloc, __ATOMIC_RELAXED) & SIZE_MASK) - HEADER_SIZE;
+}
+
+/*
+ * get_arena_id - gets the index of the arena owning the block.
+ */
+size_t get_arena_id(memory_block_t *block) {
+    assert(block != NULL);
+    return (__atomic_load_n(&block->block_size_alloc, __ATOMIC_RELAXED) & ARENA_MASK) >> ARENA_SHIFT;
+}
+
+void set_arena_id(memory_block_t *block, size_t arena_id) {
+    assert(block != NULL);
+    assert(arena_id < MAX_ARENAS);
+    block->block_size_alloc &= ~ARENA_MASK;
+    block->block_size_alloc |= arena_id << ARENA_SHIFT;
+}
+
+/*
+ * count_arenas - uses twice as many arenas as there are online CPUs. Only
+ * runs once a second thread allocates, so single threaded programs never pay
+ * for the sysconf() call.
+ */
+static void count_arenas() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = cpus > 0 ? 2 * cpus : 1;
+    __atomic_store_n(&num_arenas, count < MAX_ARENAS ? count : MAX_ARENAS, __ATOMIC_RELAXED);
+}
+
+/*
+ * get_thread_arena - hands out arenas round robin the first time a thread
+ * asks for one.
+ */
+arena_t *get_thread_arena() {
+    if (!thread_arena) {
+        size_t ticket = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        if (ticket > 0) {
+            pthread_once(&num_arenas_once, count_arenas);
+        }
+        thread_arena = &arenas[ticket % __atomic_load_n(&num_arenas, __ATOMIC_RELAXED)];
+    }
+    return thread_arena;
+}
+
+/*
+ * lock_thread_arena - locks the calling thread's arena. When it is contended
+ * the thread moves to the first other arena it can lock without waiting, and
+ * only blocks when every arena is busy.
+ */
+static arena_t *lock_thread_arena() {
+    arena_t *arena = get_thread_arena();
+    if (pthread_mutex_trylock(&arena->lock) == 0) {
+        return arena;
+    }
+    size_t count = __atomic_load_n(&num_arenas, __ATOMIC_RELAXED);
+    for (size_t i = 1; i < count; i++) {
+        arena_t *other = &arenas[(arena - arenas + i) % count];
+        if (pthread_mutex_trylock(&other->lock) == 0) {
+            thread_arena = other;
+            return other;
+        }
+    }
+    pthread_mutex_lock(&arena->lock);
+    return arena;
+}
+
+memory_block_t *get_first_block(heap_chunk_t *chunk) {
+    assert(chunk != NULL);
+    return ((void *) chunk) + sizeof(heap_chunk_t) + CHUNK_PAD;
+}
+
+memory_block_t *get_last_block(heap_chunk_t *chunk) {
+    assert(chunk != NULL);
+    return *(memory_block_t **) (((void *) chunk) + chunk->size - CHUNK_PAD);
+}
+
+/*
+ * set_last_block - keeps the slack at the end of a chunk pointing at its last
+ * block, allocated or not, so that a contiguous extension can link up with it.
+ * Must follow every change to which block is last or where it ends.
+ */
+void set_last_block(memory_block_t *block) {
+    assert(block != NULL && !has_proceeding(block));
+    *(memory_block_t **) (((void *) block) + get_entire_size(block)) = block;
 }
 
 /*
@@ -120,12 +452,11 @@ memory_block_t *get_prev(memory_block_t *block) {
  */
 void put_block(memory_block_t *block, size_t size, bool alloc) {
     assert(block != NULL);
-    assert(size % ALIGNMENT == 0);
+    assert((size + HEADER_SIZE) % ALIGNMENT == 0);
     assert(alloc >> 1 == 0);
-    block->block_size_alloc = size | alloc;
+    block->block_size_alloc = (size + HEADER_SIZE) | alloc;
     block->prev = NULL;
     block->next = NULL;
-    block->prev_adjacent = NULL;
 }
 
 /*
@@ -133,7 +464,7 @@ void put_block(memory_block_t *block, size_t size, bool alloc) {
  */
 void *get_payload(memory_block_t *block) {
     assert(block != NULL);
-    return (void*)(block + 1);
+    return ((void*) block) + HEADER_SIZE;
 }
 
 /*
@@ -141,7 +472,7 @@ void *get_payload(memory_block_t *block) {
  */
 memory_block_t *get_block(void *payload) {
     assert(payload != NULL);
-    return ((memory_block_t *)payload) - 1;
+    return (memory_block_t *) (payload - HEADER_SIZE);
 }
 
 /*
@@ -149,7 +480,14 @@ memory_block_t *get_block(void *payload) {
  *      Describe how you select which free block to allocate. What placement strategy are you using?
  *
  *
- *      I allocate the first free block which fits the description
+ *      Free blocks are segregated by size. Payloads below SMALL_CLASS_LIMIT have an exact
+ *      class per ALIGNMENT step, so the head of the first non-empty class at or above the
+ *      request's fits and is taken. Larger payloads sit in a red-black tree ordered by size,
+ *      which is searched best fit when no small class fits. A recently freed block whose
+ *      coalescing was deferred is reused first if the request fills it without a split.
+ *      Requests of at most SLAB_LIMIT bytes never reach the free lists, they take the lowest
+ *      free slot of the first slab of their class that has one. Requests of at least the
+ *      mmap threshold get a region of their own and never touch an arena.
  */
 
 size_t get_min_padded_size(size_t payload_size, size_t type_size) {
@@ -159,7 +497,7 @@ size_t get_min_padded_size(size_t payload_size, size_t type_size) {
 
 size_t get_entire_size(memory_block_t * block) {
     assert(block);
-    return get_min_padded_size(get_size(block), sizeof(memory_block_t));
+    return block->block_size_alloc & SIZE_MASK;
 }
 
 void check_adjacent(memory_block_t *block, bool st, bool print) {
@@ -169,248 +507,864 @@ void check_adjacent(memory_block_t *block, bool st, bool print) {
     while (has_proceeding(temp0)) {
         memory_block_t *next = get_proceeding(temp0);
         if (print) printf("\tTEMP 0:next %p:%p:%d\n", temp0, next, is_allocated(temp0));
-        A &= (temp0 == get_preceeding(next));
-        if (print) printf("\t\t%p:%d\n", get_preceeding(next), has_preceeding(next));
-        temp0 = next;
-    }
-
-
-    temp0 = block;
-//    temp0 = has_preceeding(temp0) ? get_preceeding(temp0) : temp0;
-    if (print) printf("SPLIT LISTING PRECEEDINGS\n");
-    while(has_preceeding(temp0)) {
-        memory_block_t *next = get_preceeding(temp0);
-        if (print) printf("\tTEMP 0:next %p:%p:%d\n", temp0, next, is_allocated(temp0));
-        A &= (temp0 == get_proceeding(next));
-        if (print) printf("\t\t%p:%d\n", get_proceeding(next), has_proceeding(next));
+        A &= has_preceeding(next) && has_free_preceeding(next) == !is_allocated(temp0);
+        if (!is_allocated(temp0)) {
+            A &= (temp0 == get_preceeding(next));
+        }
+        if (print) printf("\t\t%p:%d:%d\n", get_preceeding(next), has_preceeding(next), has_free_preceeding(next));
         temp0 = next;
     }
     assert(!st || A);
 }
 
-void check_all(bool st, bool print) {
-    memory_block_t * cur = free_head;
-    while(cur) {
+static void check_tree(tree_node_t *node, bool st, bool print) {
+    if (!node) {
+        return;
+    }
+    check_tree(node->child[0], st, print);
+    memory_block_t *cur = &node->block;
+    do {
         check_adjacent(cur, st, print);
         cur = cur->next;
+    } while (cur != &node->block);
+    check_tree(node->child[1], st, print);
+}
+
+void check_all(bool st, bool print) {
+    for (size_t arena_id = 0; arena_id < num_arenas; arena_id++) {
+        for (size_t class = 0; class < NUM_SIZE_CLASSES; class++) {
+            memory_block_t * cur = arenas[arena_id].free_lists[class];
+            while(cur) {
+                check_adjacent(cur, st, print);
+                cur = cur->next;
+            }
+        }
+        check_tree(arenas[arena_id].large_tree, st, print);
     }
 }
 
 /*
-    @Description: add a block into the free block linked list, without using any hints
-        if needed this assignment may be optimised by adding another function to insert with a hint
-*/
-void insert_free_block_no_context(memory_block_t *new_free) {
-    memory_block_t *cur = free_head;
-
-    if (!cur) {
-        free_head = new_free;
-        free_head->prev = NULL;
-        free_head->next = NULL;
-        return;
+ * get_size_class - maps a payload size to its free list. Sizes below
+ * SMALL_CLASS_LIMIT have one class per ALIGNMENT step, larger ones map past
+ * the last class as they live in the large block tree.
+ */
+size_t get_size_class(size_t size) {
+    if (size < SMALL_CLASS_LIMIT) {
+        return size / ALIGNMENT;
     }
+    return NUM_SIZE_CLASSES;
+}
 
-    if (cur > new_free) {
-        free_head = new_free;
-        cur->prev = new_free;
-        free_head->next = cur;
-        free_head->prev = NULL;
-        return;
-    }
-    while (cur < new_free && cur->next) cur = cur->next;
+/*
+ * tree_size - the key of a large block tree node.
+ */
+static size_t tree_size(tree_node_t *node) {
+    return get_size(&node->block);
+}
 
-    if (cur >= new_free) {
-        assert(cur != new_free);
-        new_free->next = cur;
-        new_free->prev = cur->prev;
-        if (cur->prev) {
-            cur->prev->next = new_free;
-        }
-        cur->prev = new_free;
+/*
+ * tree_replace - points the parent of old, or the root, at new instead.
+ */
+static void tree_replace(arena_t *arena, tree_node_t *old, tree_node_t *new) {
+    tree_node_t *parent = old->parent;
+    if (!parent) {
+        arena->large_tree = new;
+    }
+    else {
+        parent->child[parent->child[1] == old] = new;
     }
-    else { // !cur->next
-        cur->next = new_free;
-        new_free->prev = cur;
+    if (new) {
+        new->parent = parent;
     }
-    return;
 }
 
 /*
-    @Description: add a block into the free block list, provide a hint as to the previous free block
-*/
-void insert_free_block_hint(memory_block_t *new_free, memory_block_t *hint) {
-    if (!hint || new_free < hint) {
-        return insert_free_block_no_context(new_free);
-    }    
-    if (new_free > hint && (!hint->next || new_free < hint->next)) {
-        new_free->prev = hint;
-        new_free->next = hint->next;
-        hint->next = new_free;
-        if (new_free->next) {
-            new_free->next->prev = new_free;
-        }
-    }
-    else {
-        return insert_free_block_no_context(new_free);
+ * tree_rotate - rotates node down in direction dir (0 for left, 1 for right),
+ * its child on the other side takes its place.
+ */
+static void tree_rotate(arena_t *arena, tree_node_t *node, int dir) {
+    tree_node_t *up = node->child[!dir];
+    node->child[!dir] = up->child[dir];
+    if (up->child[dir]) {
+        up->child[dir]->parent = node;
     }
+    tree_replace(arena, node, up);
+    up->child[dir] = node;
+    node->parent = up;
 }
 
+static bool tree_red(tree_node_t *node) {
+    return node && node->red;
+}
 
 /*
- * find - finds a free block that can satisfy the umalloc request.
+ * tree_insert - files a large free block under its size. A block whose size
+ * is already in the tree joins that node's ring, otherwise it becomes a red
+ * leaf and the red-black properties are restored.
  */
-memory_block_t *find(size_t size) {
-    //? STUDENT TODO
-    memory_block_t * cur = free_head;
-    memory_block_t * prev = NULL;
-    while (cur) {
-        size_t min_padded_size = get_min_padded_size(size, 0);
-        size_t payload_size = get_size(cur);
-        if (payload_size >= min_padded_size) {
-            if (payload_size >= min_padded_size + SPLIT_THRESHOLD) {
-                split(cur, min_padded_size);
-            }
-            else {
-                if (cur->prev) {
-                    cur->prev->next = cur->next;
-                }
-                if (cur->next) {
-                    cur->next->prev = cur->prev;
-                }
-                allocate(cur);
-            }
-            if (cur == free_head) {
-                free_head = cur->next;
-            }
-            return cur;
+static void tree_insert(arena_t *arena, tree_node_t *node) {
+    size_t size = tree_size(node);
+    tree_node_t *parent = NULL;
+    tree_node_t **link = &arena->large_tree;
+    while (*link) {
+        parent = *link;
+        if (tree_size(parent) == size) {
+            node->in_tree = false;
+            node->block.prev = &parent->block;
+            node->block.next = parent->block.next;
+            parent->block.next->prev = &node->block;
+            parent->block.next = &node->block;
+            return;
         }
-        prev = cur;
-        cur = cur->next;
+        link = &parent->child[size > tree_size(parent)];
     }
-    memory_block_t *ext = extend_hint(size, prev);
-    if (!ext) {
-        return NULL;
+    node->in_tree = true;
+    node->block.prev = node->block.next = &node->block;
+    node->parent = parent;
+    node->child[0] = node->child[1] = NULL;
+    node->red = true;
+    *link = node;
+
+    while (tree_red(node->parent)) {
+        parent = node->parent;
+        tree_node_t *grandparent = parent->parent;
+        int dir = parent == grandparent->child[1];
+        tree_node_t *uncle = grandparent->child[!dir];
+        if (tree_red(uncle)) {
+            parent->red = uncle->red = false;
+            grandparent->red = true;
+            node = grandparent;
+            continue;
+        }
+        if (node == parent->child[!dir]) {
+            tree_rotate(arena, parent, dir);
+            node = parent;
+            parent = node->parent;
+        }
+        parent->red = false;
+        grandparent->red = true;
+        tree_rotate(arena, grandparent, !dir);
     }
-    split(ext, size);
-    return ext;
+    arena->large_tree->red = false;
 }
 
 /*
- * extend - extends the heap if more memory is required.
+ * tree_erase - unlinks a node with no ring from the tree and restores the
+ * red-black properties.
  */
-memory_block_t *extend(size_t size) {
-    //? STUDENT TODO
-    size_t DEFAULT_SIZE = PAGESIZE * 4;
-    size_t request = size > DEFAULT_SIZE - sizeof(memory_block_t) ? ((PAGESIZE - (size % PAGESIZE)) % PAGESIZE) + size + PAGESIZE : DEFAULT_SIZE;
-    void * new_heap = csbrk(request);
-
-    memory_block_t *new_free = new_heap;
-    size_t payload_size = request - get_min_padded_size(0, sizeof(memory_block_t));
-
-    put_block(new_free, payload_size, false);
-    set_no_preceeding(new_free);
-    set_no_proceeding(new_free);
-    //new_free->prev_adjacent = NULL
-
-    insert_free_block_no_context(new_free);
+static void tree_erase(arena_t *arena, tree_node_t *node) {
+    tree_node_t *child;
+    tree_node_t *parent;
+    bool removed_red = node->red;
+    if (!node->child[0] || !node->child[1]) {
+        child = node->child[0] ? node->child[0] : node->child[1];
+        parent = node->parent;
+        tree_replace(arena, node, child);
+    }
+    else {
+        // the in order successor takes node's place
+        tree_node_t *next = node->child[1];
+        while (next->child[0]) {
+            next = next->child[0];
+        }
+        removed_red = next->red;
+        child = next->child[1];
+        if (next->parent == node) {
+            parent = next;
+        }
+        else {
+            parent = next->parent;
+            tree_replace(arena, next, child);
+            next->child[1] = node->child[1];
+            next->child[1]->parent = next;
+        }
+        tree_replace(arena, node, next);
+        next->child[0] = node->child[0];
+        next->child[0]->parent = next;
+        next->red = node->red;
+    }
+    if (removed_red) {
+        return;
+    }
 
-    return new_free;
+    while (child != arena->large_tree && !tree_red(child)) {
+        int dir = child == parent->child[1];
+        tree_node_t *sibling = parent->child[!dir];
+        if (sibling->red) {
+            sibling->red = false;
+            parent->red = true;
+            tree_rotate(arena, parent, dir);
+            sibling = parent->child[!dir];
+        }
+        if (!tree_red(sibling->child[0]) && !tree_red(sibling->child[1])) {
+            sibling->red = true;
+            child = parent;
+            parent = child->parent;
+            continue;
+        }
+        if (!tree_red(sibling->child[!dir])) {
+            sibling->child[dir]->red = false;
+            sibling->red = true;
+            tree_rotate(arena, sibling, !dir);
+            sibling = parent->child[!dir];
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        sibling->child[!dir]->red = false;
+        tree_rotate(arena, parent, dir);
+        child = arena->large_tree;
+    }
+    if (child) {
+        child->red = false;
+    }
 }
 
 /*
- * extend - extends the heap if more memory is required.
+ * tree_remove - takes a large free block out of its arena's tree. Ring
+ * members are unlinked in constant time, a tree node with a ring hands its
+ * place to the next block of the same size.
  */
-memory_block_t *extend_hint(size_t size, memory_block_t * hint) {
-    //? STUDENT TODO
-    size_t DEFAULT_SIZE = PAGESIZE * 4;
-    size_t request = size > DEFAULT_SIZE - sizeof(memory_block_t) ? ((PAGESIZE - (size % PAGESIZE)) % PAGESIZE) + size + PAGESIZE : DEFAULT_SIZE;
-    void * new_heap = csbrk(request);
-
-    memory_block_t *new_free = new_heap;
-    size_t payload_size = request - get_min_padded_size(0, sizeof(memory_block_t));
-
-    put_block(new_free, payload_size, false);
-    set_no_preceeding(new_free);
-    set_no_proceeding(new_free);
-    //new_free->prev_adjacent = NULL
-
-    insert_free_block_hint(new_free, hint);
-
-    return new_free;
+static void tree_remove(arena_t *arena, tree_node_t *node) {
+    tree_node_t *next = (tree_node_t *) node->block.next;
+    if (next != node) {
+        node->block.prev->next = node->block.next;
+        node->block.next->prev = node->block.prev;
+        if (!node->in_tree) {
+            return;
+        }
+        next->in_tree = true;
+        next->red = node->red;
+        next->child[0] = node->child[0];
+        next->child[1] = node->child[1];
+        for (int dir = 0; dir < 2; dir++) {
+            if (next->child[dir]) {
+                next->child[dir]->parent = next;
+            }
+        }
+        tree_replace(arena, node, next);
+        return;
+    }
+    tree_erase(arena, node);
 }
 
-
 /*
- *  STUDENT TODO:
- *      Describe how you chose to split allocated blocks. Always? Sometimes? Never? Which end?
- *
- *  Allocated blocks will be split whenever the amount of excess space is above a threshold SPLIT_THRESHOLD
-*/
-
-/*
- * split - splits a given block in parts, one allocated, one free.
- *
- * @Return: the new free block
+ * tree_best_fit - finds the smallest size of at least size bytes in the tree,
+ * preferring a block from its ring as those come out without rebalancing.
  */
-memory_block_t *split(memory_block_t *block, size_t size) {
-    //? STUDENT TODO
-    assert(!is_allocated(block));
-    size_t original_size = get_size(block);
-    size_t total_space = get_entire_size(block);
-    size_t min_padded_size = get_min_padded_size(size, sizeof(memory_block_t));
-    size_t min_padded_payload = min_padded_size - sizeof(memory_block_t);
-    size_t free_block_alloc = total_space - min_padded_size - sizeof(memory_block_t);
-
-    if (min_padded_size + sizeof(memory_block_t) + SPLIT_THRESHOLD >= original_size) {
-        assert(total_space >= min_padded_size);
-        allocate(block);
-        if (block == free_head) {
-            free_head = block->next;
-        }
-        if (block->prev) {
-            block->prev->next = block->next;
+memory_block_t *tree_best_fit(arena_t *arena, size_t size) {
+    tree_node_t *best = NULL;
+    tree_node_t *node = arena->large_tree;
+    size_t visited = 0;
+    while (node) {
+        visited++;
+        if (tree_size(node) >= size) {
+            best = node;
+            if (tree_size(node) == size) {
+                break;
+            }
+            node = node->child[0];
         }
-        if (block->next) {
-            block->next->prev = block->prev;
+        else {
+            node = node->child[1];
         }
-
-        return block;
     }
-    memory_block_t * free = ((void*) block) + min_padded_size;
+    count_search(visited);
+    return best ? best->block.next : NULL;
+}
 
-    put_block(free, free_block_alloc, false);
-    free->next = block->next;
-    free->prev = block->prev;
-    free->prev_adjacent = block;
-    if (block == free_head) {
-        free_head = free;
-    }
-    if (free->next) {
-        free->next->prev = free;
+/*
+ * tree_successor - returns the node holding the next larger size.
+ */
+static tree_node_t *tree_successor(tree_node_t *node) {
+    if (node->child[1]) {
+        node = node->child[1];
+        while (node->child[0]) {
+            node = node->child[0];
+        }
+        return node;
     }
-    if (free->prev) {
-        free->prev->next = free;
+    while (node->parent && node == node->parent->child[1]) {
+        node = node->parent;
     }
+    return node->parent;
+}
 
-    if (has_proceeding(block)) {
-        set_exists_proceeding(free);
-        get_proceeding(free)->prev_adjacent = free;
-    }
-    else {
-        set_no_proceeding(free);
+/*
+    @Description: add a block to the front of the free list of its size class, without using any hints
+        freed blocks are reused most-recently-freed first, which keeps the insertion constant time
+*/
+void insert_free_block_no_context(memory_block_t *new_free) {
+    size_t class = get_size_class(get_size(new_free));
+    arena_t *arena = &arenas[get_arena_id(new_free)];
+    if (class == NUM_SIZE_CLASSES) {
+        return tree_insert(arena, (tree_node_t *) new_free);
     }
-    set_exists_proceeding(block);
-    set_exists_preceeding(free);
+    memory_block_t *head = arena->free_lists[class];
 
-    block->next = free;
-    allocate(block);
-    set_size(block, min_padded_payload);
+    new_free->prev = NULL;
+    new_free->next = head;
+    if (head) {
+        head->prev = new_free;
+    }
+    arena->free_lists[class] = new_free;
+    arena->nonempty_classes |= 1UL << class;
+}
 
-    return free;
+/*
+    @Description: add a block into the free list of its size class directly after hint,
+        the hint is only used when it belongs to the same class
+*/
+void insert_free_block_hint(memory_block_t *new_free, memory_block_t *hint) {
+    size_t class = get_size_class(get_size(new_free));
+    if (!hint || class == NUM_SIZE_CLASSES || get_size_class(get_size(hint)) != class) {
+        return insert_free_block_no_context(new_free);
+    }
+    new_free->prev = hint;
+    new_free->next = hint->next;
+    hint->next = new_free;
+    if (new_free->next) {
+        new_free->next->prev = new_free;
+    }
 }
 
 /*
- * coalesce - coalesces a free memory block with neighbors.
+ * remove_free_block - unlinks a block from the free list of its size class.
+ */
+void remove_free_block(memory_block_t *block) {
+    assert(block);
+    if (get_size(block) >= SMALL_CLASS_LIMIT) {
+        return tree_remove(&arenas[get_arena_id(block)], (tree_node_t *) block);
+    }
+    if (block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        size_t class = get_size_class(get_size(block));
+        arena_t *arena = &arenas[get_arena_id(block)];
+        assert(arena->free_lists[class] == block);
+        arena->free_lists[class] = block->next;
+        if (!block->next) {
+            arena->nonempty_classes &= ~(1UL << class);
+        }
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+}
+
+/*
+ * grow_footprint - accounts for bytes obtained from csbrk or mmap, keeping the
+ * peak up to date.
+ */
+static void grow_footprint(size_t bytes) {
+    size_t footprint = __atomic_add_fetch(&stats.footprint, bytes, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats.peak_footprint, __ATOMIC_RELAXED);
+    while (footprint > peak) {
+        if (__atomic_compare_exchange_n(&stats.peak_footprint, &peak, footprint, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static void shrink_footprint(size_t bytes) {
+    __atomic_sub_fetch(&stats.footprint, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * trim_top - shrinks the heap when top is the free block at the end of the
+ * arena's newest chunk and that chunk ends at the program break, leaving pad
+ * bytes in top. Returns the number of bytes given back. The arena's lock must
+ * be held.
+ */
+static size_t trim_top(arena_t *arena, memory_block_t *top, size_t pad) {
+    heap_chunk_t *chunk = arena->chunks;
+    void *chunk_end = ((void *) chunk) + chunk->size;
+    if (is_allocated(top) || has_proceeding(top) || ((void *) top) + get_entire_size(top) != chunk_end - CHUNK_PAD) {
+        return 0;
+    }
+    size_t keep = pad > MIN_BLOCK_SIZE ? pad : MIN_BLOCK_SIZE;
+    if (get_entire_size(top) < keep + PAGESIZE) {
+        return 0;
+    }
+    size_t release = (get_entire_size(top) - keep) & ~((size_t) PAGESIZE - 1);
+    pthread_mutex_lock(&sbrk_lock);
+    void *region = sbrk(0) == chunk_end ? csbrk(-(intptr_t) release) : NULL;
+    pthread_mutex_unlock(&sbrk_lock);
+    if (!region || region == (void *) -1) {
+        return 0;
+    }
+    remove_free_block(top);
+    shrink_footprint(release);
+    arena->heap_bytes -= release;
+    arena->growth_streak = 0;
+    chunk->size -= release;
+    set_size(top, get_size(top) - release);
+    put_footer(top);
+    insert_free_block_no_context(top);
+    return release;
+}
+
+/*
+ * release_chunk - gives the arena's newest chunk back to the OS when block is
+ * the only block in it, the chunk ends at the program break and an older
+ * chunk remains. Returns the number of bytes given back. The arena's lock must
+ * be held.
+ */
+static size_t release_chunk(arena_t *arena, memory_block_t *block) {
+    heap_chunk_t *chunk = arena->chunks;
+    if (!chunk->next || block != get_first_block(chunk) || is_allocated(block) || has_proceeding(block)) {
+        return 0;
+    }
+    size_t size = chunk->size;
+    bool released = false;
+    pthread_mutex_lock(&sbrk_lock);
+    if (sbrk(0) == ((void *) chunk) + size) {
+        // the block's links are gone once the memory is
+        remove_free_block(block);
+        arena->chunks = chunk->next;
+        void *region = csbrk(-(intptr_t) size);
+        released = region && region != (void *) -1;
+        if (!released) {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+            insert_free_block_no_context(block);
+        }
+    }
+    pthread_mutex_unlock(&sbrk_lock);
+    if (!released) {
+        return 0;
+    }
+    shrink_footprint(size);
+    arena->heap_bytes -= size;
+    arena->growth_streak = 0;
+    return size;
+}
+
+/*
+ * decommit - drops the whole pages of free block that lie within [start, end),
+ * sparing its free list fields and footer, when there are at least min bytes
+ * of them. The pages read as zero once touched again. Returns the number of
+ * bytes dropped.
+ */
+static size_t decommit(memory_block_t *block, void *start, void *end, size_t min) {
+    uintptr_t low = (uintptr_t) block + sizeof(tree_node_t);
+    uintptr_t high = (uintptr_t) block + get_entire_size(block) - sizeof(size_t);
+    low = (uintptr_t) start > low ? (uintptr_t) start : low;
+    high = (uintptr_t) end < high ? (uintptr_t) end : high;
+    low = (low + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1);
+    high &= ~((uintptr_t) PAGESIZE - 1);
+    if (high < low + min || madvise((void *) low, high - low, MADV_DONTNEED) != 0) {
+        return 0;
+    }
+    return high - low;
+}
+
+/*
+ * release_free - gives memory back to the OS once the bytes freed over
+ * [start, end) coalesced into a block of at least the arena's trim threshold,
+ * releasing its chunk or trimming it when it is the top of the heap and
+ * dropping the freed pages otherwise. The arena's lock must be held.
+ */
+static void release_free(arena_t *arena, memory_block_t *block, void *start, void *end) {
+    if (get_entire_size(block) < arena->trim_at) {
+        return;
+    }
+    if (release_chunk(arena, block) || trim_top(arena, block, arena->trim_at / 2) || decommit(block, start, end, DECOMMIT_MIN)) {
+        arena->released = true;
+    }
+}
+
+/*
+ * note_growth - accounts for increment bytes an arena got from csbrk. Growing
+ * again after giving memory back on a free means the threshold was too low
+ * for the workload, so the arena's own threshold doubles.
+ */
+static void note_growth(arena_t *arena, size_t increment) {
+    __atomic_add_fetch(&stats.csbrk_calls, 1, __ATOMIC_RELAXED);
+    grow_footprint(increment);
+    arena->heap_bytes += increment;
+    if (arena->released) {
+        arena->released = false;
+        arena->trim_at = arena->trim_at < SIZE_MAX / 2 ? arena->trim_at * 2 : SIZE_MAX;
+    }
+}
+
+static int compare_pointers(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) *(void * const *) a;
+    uintptr_t y = (uintptr_t) *(void * const *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * free_adjacent - frees the allocated block of ptrs[0] together with the run
+ * of allocated blocks right behind it whose payloads follow it in ptrs, which
+ * must be sorted by address. The run is merged into one free block before a
+ * single coalesce. Returns how many entries of ptrs were freed. The arena's
+ * lock must be held.
+ */
+static size_t free_adjacent(arena_t *arena, void **ptrs, size_t n) {
+    memory_block_t *block = get_block(ptrs[0]);
+    memory_block_t *last = block;
+    size_t i = 1;
+    assert(is_allocated(block));
+    while (i < n && ptrs[i] && has_proceeding(last) && get_block(ptrs[i]) == get_proceeding(last)) {
+        last = get_proceeding(last);
+        assert(is_allocated(last));
+        i++;
+    }
+    void *end = ((void *) last) + get_entire_size(last);
+    deallocate(block);
+    set_zeroed(block, false);
+    if (last != block) {
+        set_size(block, ((void *) last) - ((void *) block) + get_size(last));
+        if (has_proceeding(last)) {
+            set_exists_proceeding(block);
+        }
+        else {
+            set_no_proceeding(block);
+        }
+    }
+    release_free(arena, coalesce(block), block, end);
+    return i;
+}
+
+/*
+ * flush_deferred - coalesces every block whose free the arena held back, in
+ * address order so that neighbors are merged while they are still in cache.
+ * The arena's lock must be held.
+ */
+static void flush_deferred(arena_t *arena) {
+    qsort(arena->deferred, arena->num_deferred, sizeof(void *), compare_pointers);
+    for (size_t i = 0; i < arena->num_deferred; ) {
+        i += free_adjacent(arena, arena->deferred + i, arena->num_deferred - i);
+    }
+    arena->num_deferred = 0;
+}
+
+/*
+ * take_deferred - hands out the most recently held back block of arena that a
+ * payload of min_padded_size fills without leaving room to split off, NULL if
+ * there is none. The arena's lock must be held.
+ */
+static memory_block_t *take_deferred(arena_t *arena, size_t min_padded_size) {
+    for (size_t i = arena->num_deferred; i-- > 0; ) {
+        memory_block_t *block = get_block(arena->deferred[i]);
+        if (get_size(block) >= min_padded_size && get_size(block) < min_padded_size + MIN_BLOCK_SIZE) {
+            arena->deferred[i] = arena->deferred[--arena->num_deferred];
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * find_listed - returns the listed free block of arena that fits a payload of
+ * min_padded_size best, NULL if there is none.
+ */
+static memory_block_t *find_listed(arena_t *arena, size_t min_padded_size) {
+    // every block of an exact class has the same size, so the head of the first non-empty class at or above the request's fits
+    uint64_t fitting = arena->nonempty_classes & (~0UL << get_size_class(min_padded_size));
+    if (fitting) {
+        count_search(1);
+        return arena->free_lists[__builtin_ctzl(fitting)];
+    }
+    return tree_best_fit(arena, min_padded_size);
+}
+
+/*
+ * find_fit - returns a listed free block of the calling thread's arena with a
+ * payload of at least min_padded_size, merging the arena's deferred frees and
+ * then extending it if there is none.
+ */
+static memory_block_t *find_fit(size_t min_padded_size) {
+    arena_t *arena = get_thread_arena();
+    memory_block_t *block = find_listed(arena, min_padded_size);
+    if (!block && arena->num_deferred) {
+        flush_deferred(arena);
+        block = find_listed(arena, min_padded_size);
+    }
+    return block ? block : extend_hint(min_padded_size, NULL);
+}
+
+/*
+ * find - finds a free block that can satisfy the umalloc request.
+ */
+memory_block_t *find(size_t size) {
+    //? STUDENT TODO
+    size_t min_padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size) - HEADER_SIZE;
+    memory_block_t *block = take_deferred(get_thread_arena(), min_padded_size);
+    if (block) {
+        return block;
+    }
+    block = find_fit(min_padded_size);
+    if (!block) {
+        return NULL;
+    }
+    split(block, min_padded_size);
+    return block;
+}
+
+/*
+ * aligned_payload - returns where an aligned payload would start inside a
+ * free block, leaving room for a free block in front unless the block's own
+ * payload is already aligned.
+ */
+static uintptr_t aligned_payload(memory_block_t *block, size_t alignment) {
+    uintptr_t payload = (uintptr_t) get_payload(block);
+    if (payload % alignment == 0) {
+        return payload;
+    }
+    return (payload + MIN_BLOCK_SIZE + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * fits_aligned - returns whether a free block can hold an aligned payload of
+ * min_padded_size bytes, with enough left behind any front piece for split()
+ * to cut it off.
+ */
+static bool fits_aligned(memory_block_t *block, size_t min_padded_size, size_t alignment) {
+    size_t min_behind = min_padded_size > SPLIT_THRESHOLD ? min_padded_size : SPLIT_THRESHOLD;
+    uintptr_t aligned = aligned_payload(block, alignment);
+    uintptr_t end = (uintptr_t) get_payload(block) + get_size(block);
+    return end >= aligned + (aligned == (uintptr_t) get_payload(block) ? min_padded_size : min_behind);
+}
+
+/*
+ * find_aligned - like find, but the payload of the returned block starts on a
+ * multiple of alignment. The first listed block that can hold an aligned
+ * payload is used, any piece in front of that payload is freed again.
+ */
+static memory_block_t *find_aligned(size_t size, size_t alignment) {
+    assert(alignment % ALIGNMENT == 0 && (alignment & (alignment - 1)) == 0);
+    arena_t *arena = get_thread_arena();
+    // held back blocks rarely have the right alignment, but may merge into a block that does
+    if (arena->num_deferred) {
+        flush_deferred(arena);
+    }
+    size_t min_padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size) - HEADER_SIZE;
+    size_t min_behind = min_padded_size > SPLIT_THRESHOLD ? min_padded_size : SPLIT_THRESHOLD;
+    memory_block_t *block = NULL;
+    uint64_t fitting = arena->nonempty_classes & (~0UL << get_size_class(min_padded_size));
+    for (; fitting && !block; fitting &= fitting - 1) {
+        for (memory_block_t *cur = arena->free_lists[__builtin_ctzl(fitting)]; cur; cur = cur->next) {
+            if (fits_aligned(cur, min_padded_size, alignment)) {
+                block = cur;
+                break;
+            }
+        }
+    }
+    // walk the tree upwards from the best fit, any block of the worst case size fits whatever its alignment
+    size_t worst_case = min_behind + alignment + MIN_BLOCK_SIZE;
+    tree_node_t *node = (tree_node_t *) tree_best_fit(arena, min_padded_size);
+    if (node && !node->in_tree) {
+        node = (tree_node_t *) node->block.prev;
+    }
+    for (; node && !block; node = tree_successor(node)) {
+        memory_block_t *cur = &node->block;
+        do {
+            if (get_size(cur) >= worst_case || fits_aligned(cur, min_padded_size, alignment)) {
+                block = cur;
+                break;
+            }
+            cur = cur->next;
+        } while (cur != &node->block);
+    }
+    if (!block) {
+        block = extend_hint(min_behind + alignment + MIN_BLOCK_SIZE, NULL);
+        if (!block) {
+            return NULL;
+        }
+    }
+    uintptr_t payload = (uintptr_t) get_payload(block);
+    uintptr_t aligned = aligned_payload(block, alignment);
+    if (aligned == payload) {
+        split(block, min_padded_size);
+        return block;
+    }
+    memory_block_t *front = block;
+    split(front, aligned - payload - HEADER_SIZE);
+    block = get_proceeding(front);
+    assert(get_payload(block) == (void *) aligned);
+    split(block, min_padded_size);
+    deallocate(front);
+    coalesce(front);
+    return block;
+}
+
+/*
+ * extend_chunk - grows chunk over the request bytes csbrk returned right
+ * behind it. The chunk's slack becomes the header of a new block covering
+ * them, unless its last block is free and simply grows over them. Either way
+ * the free block is returned off the free lists.
+ */
+static memory_block_t *extend_chunk(heap_chunk_t *chunk, size_t request) {
+    memory_block_t *last = get_last_block(chunk);
+    chunk->size += request;
+    if (!is_allocated(last)) {
+        remove_free_block(last);
+        if (is_zeroed(last)) {
+            // its footer and the old slack end up inside the block
+            memset(((void *) last) + get_entire_size(last) - sizeof(size_t), 0, 2 * sizeof(size_t));
+        }
+        set_size(last, get_size(last) + request);
+        put_footer(last);
+        return last;
+    }
+    memory_block_t *new_free = ((void *) last) + get_entire_size(last);
+    put_block(new_free, request - HEADER_SIZE, false);
+    set_arena_id(new_free, get_arena_id(last));
+    set_zeroed(new_free, true);
+    set_exists_preceeding(new_free);
+    set_allocated_preceeding(new_free);
+    set_no_proceeding(new_free);
+    set_exists_proceeding(last);
+    put_footer(new_free);
+    return new_free;
+}
+
+/*
+ * add_chunk - gets request bytes from csbrk for an arena, links the chunk into
+ * the arena's chunk list and covers it with a single free block that is not
+ * on any free list yet. Memory that lands right behind the arena's newest
+ * chunk extends that chunk instead, merged into its last block when free.
+ */
+static memory_block_t *add_chunk(arena_t *arena, size_t request) {
+    pthread_mutex_lock(&sbrk_lock);
+    heap_chunk_t *chunk = csbrk(request);
+    pthread_mutex_unlock(&sbrk_lock);
+    if (!chunk || chunk == (void *) -1) {
+        return NULL;
+    }
+    note_growth(arena, request);
+    heap_chunk_t *newest = arena->chunks;
+    if (newest && ((void *) newest) + newest->size == (void *) chunk) {
+        return extend_chunk(newest, request);
+    }
+    chunk->size = request;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    memory_block_t *new_free = get_first_block(chunk);
+    size_t payload_size = request - CHUNK_OVERHEAD - HEADER_SIZE;
+
+    put_block(new_free, payload_size, false);
+    set_arena_id(new_free, arena - arenas);
+    set_zeroed(new_free, true);
+    set_no_preceeding(new_free);
+    set_no_proceeding(new_free);
+    put_footer(new_free);
+    return new_free;
+}
+
+/*
+ * growth_size - how many bytes an arena grows by ahead of need: an eighth of
+ * its heap, or min_chunk doubled for each extension since it last shrank if
+ * that is more, capped at max_chunk.
+ */
+static size_t growth_size(arena_t *arena) {
+    size_t by_heap = arena->heap_bytes >> GROWTH_SHIFT;
+    size_t by_rate = min_chunk << arena->growth_streak;
+    size_t size = by_heap > by_rate ? by_heap : by_rate;
+    size = (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    return ALIGN(size < max_chunk ? size : max_chunk);
+}
+
+/*
+ * extend - extends the heap if more memory is required.
+ */
+memory_block_t *extend(size_t size) {
+    //? STUDENT TODO
+    return extend_hint(size, NULL);
+}
+
+/*
+ * extend_hint - adds a chunk to the calling thread's arena if more memory is
+ * required, filing the new block under its size class with the help of hint.
+ */
+memory_block_t *extend_hint(size_t size, memory_block_t * hint) {
+    //? STUDENT TODO
+    arena_t *arena = get_thread_arena();
+    size_t needed = ((PAGESIZE - (size % PAGESIZE)) % PAGESIZE) + size + PAGESIZE;
+    size_t request = growth_size(arena);
+    request = needed > request ? needed : request;
+    memory_block_t *new_free = add_chunk(arena, request);
+    if (!new_free) {
+        return NULL;
+    }
+    if (arena->growth_streak < MAX_GROWTH_STREAK) {
+        arena->growth_streak++;
+    }
+    // growing by min_chunk at a time, the surplus would have taken further calls
+    size_t fixed = needed > min_chunk ? needed : min_chunk;
+    if (request > fixed) {
+        __atomic_add_fetch(&stats.csbrk_avoided, (request - fixed) / min_chunk, __ATOMIC_RELAXED);
+    }
+
+    insert_free_block_hint(new_free, hint);
+
+    return new_free;
+}
+
+
+/*
+ *  STUDENT TODO:
+ *      Describe how you chose to split allocated blocks. Always? Sometimes? Never? Which end?
+ *
+ *  Allocated blocks will be split whenever the amount of excess space is above a threshold SPLIT_THRESHOLD,
+ *  the front is allocated and the free tail moves to the list of its own size class
+*/
+
+/*
+ * split - splits a given block in parts, one allocated, one free. An
+ * allocated block can be split too, which shrinks it in place. The free part
+ * of a zeroed block stays zeroed, the allocated part is no longer tracked.
+ *
+ * @Return: the new free block
+ */
+memory_block_t *split(memory_block_t *block, size_t size) {
+    //? STUDENT TODO
+    size_t total_space = get_entire_size(block);
+    size_t min_padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size);
+    size_t min_padded_payload = min_padded_size - HEADER_SIZE;
+    size_t free_block_alloc = total_space - min_padded_size - HEADER_SIZE;
+    bool zeroed = is_zeroed(block);
+
+    if (!is_allocated(block)) {
+        remove_free_block(block);
+    }
+    set_zeroed(block, false);
+    if (min_padded_size + HEADER_SIZE + SPLIT_THRESHOLD > total_space) {
+        assert(total_space >= min_padded_size);
+        allocate(block);
+        if (has_proceeding(block)) {
+            set_allocated_preceeding(get_proceeding(block));
+        }
+        return block;
+    }
+    memory_block_t * free = ((void*) block) + min_padded_size;
+
+    put_block(free, free_block_alloc, false);
+    set_arena_id(free, get_arena_id(block));
+    set_zeroed(free, zeroed);
+
+    if (has_proceeding(block)) {
+        set_exists_proceeding(free);
+    }
+    else {
+        set_no_proceeding(free);
+    }
+    set_exists_proceeding(block);
+    set_exists_preceeding(free);
+    COUNT(splits, 1);
+
+    allocate(block);
+    set_size(block, min_padded_payload);
+    // the tail of a shrinking allocated block may border a free block
+    return coalesce(free);
+}
+
+/*
+ * coalesce - coalesces a free memory block with neighbors.
  */
 memory_block_t *coalesce(memory_block_t *block) {
     //? STUDENT TODO
@@ -420,87 +1374,541 @@ memory_block_t *coalesce(memory_block_t *block) {
     memory_block_t * last = block;
     size_t new_size;
 
+    // the footer of the preceeding block is only readable while it is free
     memory_block_t * preceeding = get_preceeding(block);
     memory_block_t * proceeding = get_proceeding(block);
 
-    if (preceeding && !is_allocated(preceeding)) {
-        write_to = preceeding;
-        new_size = get_entire_size(block) + get_size(preceeding);
+    if (preceeding) {
+        assert(!is_allocated(preceeding));
+        remove_free_block(preceeding);
+        COUNT(coalesces, 1);
+        write_to = preceeding;
+        new_size = get_entire_size(block) + get_size(preceeding);
+    }
+    else {
+        new_size = get_size(block);
+    }
+
+    if (proceeding && !is_allocated(proceeding)) {
+        remove_free_block(proceeding);
+        COUNT(coalesces, 1);
+        new_size += get_entire_size(proceeding);
+        last = proceeding;
+    }
+
+    if (write_to != last) {
+        // the headers and payloads swallowed by the merge are not zero
+        set_zeroed(write_to, false);
+        set_size(write_to, new_size);
+        // has_preceeding(write_to) is unchanged, has_proceeding(write_to) becomes has_proceeding(last)
+        if (has_proceeding(last)) {
+            set_exists_proceeding(write_to);
+            assert(is_allocated(get_proceeding(write_to)));
+        }
+        else {
+            set_no_proceeding(write_to);
+        }
+    }
+    put_footer(write_to);
+    insert_free_block_no_context(write_to);
+    return write_to;
+}
+
+
+/*
+ * get_slab_class - maps a request of at most SLAB_LIMIT bytes to the class of
+ * the smallest slot holding it.
+ */
+size_t get_slab_class(size_t size) {
+    assert(size <= SLAB_LIMIT);
+    return size ? (size - 1) / ALIGNMENT : 0;
+}
+
+slab_t *get_slab(void *ptr) {
+    uintptr_t page = (uintptr_t) ptr >> SLAB_SHIFT;
+    if (page >> (PAGEMAP_ADDRESS_BITS - SLAB_SHIFT)) {
+        return NULL;
+    }
+    pagemap_leaf_t *leaf = __atomic_load_n(&pagemap[page >> PAGEMAP_LEAF_SHIFT], __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        return NULL;
+    }
+    size_t bit = page & ((1 << PAGEMAP_LEAF_SHIFT) - 1);
+    if (!((__atomic_load_n(&leaf->bits[bit / 64], __ATOMIC_RELAXED) >> (bit % 64)) & 0x1)) {
+        return NULL;
+    }
+    return (slab_t *) (page << SLAB_SHIFT);
+}
+
+/*
+ * pagemap_mark - records in the pagemap whether a slab starts at the given
+ * page, mmapping the leaf covering it on first use. Returns false when the
+ * leaf could not be mapped.
+ */
+static bool pagemap_mark(slab_t *slab, bool is_slab) {
+    uintptr_t page = (uintptr_t) slab >> SLAB_SHIFT;
+    assert(page >> (PAGEMAP_ADDRESS_BITS - SLAB_SHIFT) == 0);
+    pagemap_leaf_t *leaf = __atomic_load_n(&pagemap[page >> PAGEMAP_LEAF_SHIFT], __ATOMIC_ACQUIRE);
+    if (!leaf) {
+        pthread_mutex_lock(&pagemap_lock);
+        leaf = pagemap[page >> PAGEMAP_LEAF_SHIFT];
+        if (!leaf) {
+            leaf = mmap(NULL, sizeof(pagemap_leaf_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (leaf == MAP_FAILED) {
+                pthread_mutex_unlock(&pagemap_lock);
+                return false;
+            }
+            leaf->next = pagemap_leaves;
+            pagemap_leaves = leaf;
+            __atomic_store_n(&pagemap[page >> PAGEMAP_LEAF_SHIFT], leaf, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&pagemap_lock);
+    }
+    size_t bit = page & ((1 << PAGEMAP_LEAF_SHIFT) - 1);
+    if (is_slab) {
+        __atomic_or_fetch(&leaf->bits[bit / 64], ((uint64_t) 1) << (bit % 64), __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_and_fetch(&leaf->bits[bit / 64], ~(((uint64_t) 1) << (bit % 64)), __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+/*
+ * new_slab - carves a SLAB_SIZE aligned slab for a class out of the calling
+ * thread's arena and puts it on the arena's list for that class.
+ */
+static slab_t *new_slab(size_t class) {
+    arena_t *arena = get_thread_arena();
+    memory_block_t *block = find_aligned(SLAB_SIZE - HEADER_SIZE, SLAB_SIZE);
+    if (!block) {
+        return NULL;
+    }
+    slab_t *slab = get_payload(block);
+    if (!pagemap_mark(slab, true)) {
+        deallocate(block);
+        coalesce(block);
+        return NULL;
+    }
+    slab->slab_class = class;
+    slab->slot_size = (class + 1) * ALIGNMENT;
+    slab->num_slots = (SLAB_SIZE - HEADER_SIZE - SLAB_HEADER_SIZE) / slab->slot_size;
+    slab->num_free = slab->num_slots;
+    for (size_t word = 0; word < SLAB_BITMAP_WORDS; word++) {
+        size_t first = word * 64;
+        if (first + 64 <= slab->num_slots) {
+            slab->free_slots[word] = ~((uint64_t) 0);
+        }
+        else if (first < slab->num_slots) {
+            slab->free_slots[word] = (((uint64_t) 1) << (slab->num_slots - first)) - 1;
+        }
+        else {
+            slab->free_slots[word] = 0;
+        }
+    }
+    slab->prev = NULL;
+    slab->next = arena->slabs[class];
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    arena->slabs[class] = slab;
+    return slab;
+}
+
+/*
+ * unlink_slab - takes a slab off its arena's list of slabs with free slots.
+ */
+static void unlink_slab(arena_t *arena, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        assert(arena->slabs[slab->slab_class] == slab);
+        arena->slabs[slab->slab_class] = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/*
+ * slab_alloc - hands out the lowest free slot of the first slab of the class,
+ * found with a count trailing zeros on its occupancy bitmap. Full slabs leave
+ * the list until a slot is freed.
+ */
+void *slab_alloc(size_t class) {
+    assert(class < NUM_SLAB_CLASSES);
+    arena_t *arena = get_thread_arena();
+    slab_t *slab = arena->slabs[class];
+    if (!slab) {
+        slab = new_slab(class);
+        if (!slab) {
+            return NULL;
+        }
+    }
+    size_t word = 0;
+    while (!slab->free_slots[word]) {
+        word++;
+    }
+    assert(word < SLAB_BITMAP_WORDS);
+    size_t slot = word * 64 + __builtin_ctzl(slab->free_slots[word]);
+    slab->free_slots[word] &= slab->free_slots[word] - 1;
+    if (--slab->num_free == 0) {
+        unlink_slab(arena, slab);
+    }
+    return ((void *) slab) + SLAB_HEADER_SIZE + slot * slab->slot_size;
+}
+
+void slab_free(slab_t *slab, void *ptr) {
+    arena_t *arena = &arenas[get_arena_id(get_block(slab))];
+    size_t slot = (ptr - ((void *) slab) - SLAB_HEADER_SIZE) / slab->slot_size;
+    assert(slot < slab->num_slots);
+    assert(!((slab->free_slots[slot / 64] >> (slot % 64)) & 0x1));
+    slab->free_slots[slot / 64] |= ((uint64_t) 1) << (slot % 64);
+    if (slab->num_free++ == 0) {
+        slab->prev = NULL;
+        slab->next = arena->slabs[slab->slab_class];
+        if (slab->next) {
+            slab->next->prev = slab;
+        }
+        arena->slabs[slab->slab_class] = slab;
+    }
+    // keep one slab per class around so a class that drains and refills does not carve a slab every time
+    if (slab->num_free == slab->num_slots && (slab->prev || slab->next)) {
+        unlink_slab(arena, slab);
+        pagemap_mark(slab, false);
+        memory_block_t *block = get_block(slab);
+        deallocate(block);
+        coalesce(block);
+    }
+}
+
+/*
+ * add_mmap_bytes - accounts for bytes mapped for mmapped blocks, keeping the
+ * peak up to date.
+ */
+static void add_mmap_bytes(size_t length) {
+    size_t mmap_bytes = __atomic_add_fetch(&stats.mmap_bytes, length, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats.mmap_peak_bytes, __ATOMIC_RELAXED);
+    while (mmap_bytes > peak) {
+        if (__atomic_compare_exchange_n(&stats.mmap_peak_bytes, &peak, mmap_bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    grow_footprint(length);
+}
+
+/*
+ * mmap_region - returns the start of the mapping an mmapped block lives in,
+ * its header always sits in the first page.
+ */
+static void *mmap_region(memory_block_t *block) {
+    return (void *) ((uintptr_t) block & ~((uintptr_t) PAGESIZE - 1));
+}
+
+/*
+ * mmap_length - returns the length of the mapping an mmapped block lives in,
+ * the block ends CHUNK_PAD bytes before it.
+ */
+static size_t mmap_length(memory_block_t *block) {
+    return ((void *) block) - mmap_region(block) + get_entire_size(block) + CHUNK_PAD;
+}
+
+/*
+ * mmap_alloc - maps a region holding a single block whose payload is as close
+ * to the start as the alignment allows. Alignments above a page map extra
+ * room and unmap the pages on either side of the block afterwards.
+ */
+memory_block_t *mmap_alloc(size_t size, size_t alignment) {
+    assert(alignment >= ALIGNMENT && (alignment & (alignment - 1)) == 0);
+    if (alignment > MAX_REQUEST || size > MAX_REQUEST - alignment) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t entire_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size);
+    size_t length = (alignment - HEADER_SIZE + entire_size + CHUNK_PAD + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    void *region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    uintptr_t payload = ((uintptr_t) region + HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+    memory_block_t *block = (void *) payload - HEADER_SIZE;
+    void *start = mmap_region(block);
+    void *end = (void *) (((uintptr_t) block + entire_size + CHUNK_PAD + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1));
+    if (start > region) {
+        munmap(region, start - region);
+    }
+    if (end < region + length) {
+        munmap(end, region + length - end);
+    }
+    block->block_size_alloc = (end - ((void *) block) - CHUNK_PAD) | MMAPPED_BIT | 0x1;
+
+    add_mmap_bytes(end - start);
+    __atomic_add_fetch(&stats.mmap_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.mmap_total, 1, __ATOMIC_RELAXED);
+    return block;
+}
+
+void mmap_free(memory_block_t *block) {
+    assert(is_mmapped(block));
+    size_t length = mmap_length(block);
+    munmap(mmap_region(block), length);
+    __atomic_sub_fetch(&stats.mmap_bytes, length, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.mmap_count, 1, __ATOMIC_RELAXED);
+    shrink_footprint(length);
+}
+
+/*
+ * umalloc_stats - copies the counters out, each one is read atomically but
+ * the snapshot as a whole is not.
+ */
+void umalloc_stats(umalloc_stats_t *out) {
+    assert(out != NULL);
+    pthread_mutex_lock(&stats_lock);
+    size_t *sum = (size_t *) &out->counters;
+    for (size_t i = 0; i < sizeof(umalloc_counters_t) / sizeof(size_t); i++) {
+        sum[i] = ((size_t *) &retired_counters)[i];
+        for (thread_stats_t *thread = thread_stats_list; thread; thread = thread->next) {
+            sum[i] += __atomic_load_n(((size_t *) &thread->counters) + i, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+    out->mmap_count = __atomic_load_n(&stats.mmap_count, __ATOMIC_RELAXED);
+    out->mmap_bytes = __atomic_load_n(&stats.mmap_bytes, __ATOMIC_RELAXED);
+    out->mmap_peak_bytes = __atomic_load_n(&stats.mmap_peak_bytes, __ATOMIC_RELAXED);
+    out->mmap_total = __atomic_load_n(&stats.mmap_total, __ATOMIC_RELAXED);
+    out->csbrk_calls = __atomic_load_n(&stats.csbrk_calls, __ATOMIC_RELAXED);
+    out->csbrk_avoided = __atomic_load_n(&stats.csbrk_avoided, __ATOMIC_RELAXED);
+    out->footprint = __atomic_load_n(&stats.footprint, __ATOMIC_RELAXED);
+    out->peak_footprint = __atomic_load_n(&stats.peak_footprint, __ATOMIC_RELAXED);
+}
+
+/*
+ * tcache_get - pops a cached payload of the given class, no locking needed as
+ * the cache is private to the calling thread. Callers count the class size as
+ * allocated, the slack of a block is counted in use until it is flushed.
+ */
+void *tcache_get(size_t class) {
+    assert(class < NUM_SMALL_CLASSES);
+    void *payload = tcache.entries[class];
+    if (payload) {
+        tcache.entries[class] = *(void **) payload;
+        tcache.counts[class]--;
+    }
+    return payload;
+}
+
+/*
+ * tcache_put - caches a small payload that is being freed, the first put of a
+ * thread registers it so that its cache is flushed on exit.
+ */
+bool tcache_put(void *payload, size_t class) {
+    assert(class < NUM_SMALL_CLASSES);
+    if (tcache.counts[class] >= TCACHE_COUNT) {
+        return false;
     }
-    else {
-        new_size = get_size(block);
+    if (!thread_stats.registered) {
+        register_thread();
     }
+    *(void **) payload = tcache.entries[class];
+    tcache.entries[class] = payload;
+    tcache.counts[class]++;
+    return true;
+}
 
-    if (proceeding && !is_allocated(proceeding)) {
-        new_size += get_entire_size(proceeding);
-        last = proceeding;
+/*
+ * free_to_arena - hands a block back to the arena recorded in its header,
+ * whichever thread frees it. In deferred coalescing mode the block stays
+ * marked allocated on the arena's deferred list until the list fills up.
+ */
+static void free_to_arena(memory_block_t *block) {
+    arena_t *arena = &arenas[get_arena_id(block)];
+    pthread_mutex_lock(&arena->lock);
+    void *end = ((void *) block) + get_entire_size(block);
+    if (defer_coalescing) {
+        arena->deferred[arena->num_deferred++] = get_payload(block);
+        if (arena->num_deferred == DEFERRED_LIMIT) {
+            flush_deferred(arena);
+        }
+        pthread_mutex_unlock(&arena->lock);
+        return;
     }
+    deallocate(block);
+    release_free(arena, coalesce(block), block, end);
+    pthread_mutex_unlock(&arena->lock);
+}
 
-    if (write_to == last) {
-        insert_free_block_no_context(block);
+/*
+ * free_to_slab - hands a slot back to its slab under the lock of the arena
+ * the slab was carved from.
+ */
+static void free_to_slab(slab_t *slab, void *ptr) {
+    arena_t *arena = &arenas[get_arena_id(get_block(slab))];
+    pthread_mutex_lock(&arena->lock);
+    slab_free(slab, ptr);
+    pthread_mutex_unlock(&arena->lock);
+}
 
-        return block;
+/*
+ * tcache_flush - frees every cached payload of the calling thread into the
+ * slabs and arenas that own them.
+ */
+void tcache_flush() {
+    for (size_t class = 0; class < NUM_SMALL_CLASSES; class++) {
+        void *payload = tcache.entries[class];
+        while (payload) {
+            void *next = *(void **) payload;
+            if (class < NUM_SLAB_CLASSES) {
+                free_to_slab(get_slab(payload), payload);
+            }
+            else {
+                memory_block_t *block = get_block(payload);
+                // ufree_sized() only counted the class size as freed, so the slack of the block goes now
+                count_resize(get_size(block), (class + 1) * ALIGNMENT - HEADER_SIZE);
+                // it also caches without looking at the header, so a small block mmapped when an arena ran dry can end up here
+                if (is_mmapped(block)) {
+                    mmap_free(block);
+                }
+                else {
+                    free_to_arena(block);
+                }
+            }
+            payload = next;
+        }
+        tcache.entries[class] = NULL;
+        tcache.counts[class] = 0;
+    }
+}
+
+/*
+ * fork_prepare - takes every allocator lock before fork() so the child never
+ * inherits one held by a thread that does not exist there. A thread holds at
+ * most one arena lock and takes the sbrk, pagemap and stats locks under it,
+ * so taking the arenas first in index order cannot deadlock.
+ */
+static void fork_prepare() {
+    for (size_t arena_id = 0; arena_id < MAX_ARENAS; arena_id++) {
+        pthread_mutex_lock(&arenas[arena_id].lock);
+    }
+    pthread_mutex_lock(&sbrk_lock);
+    pthread_mutex_lock(&pagemap_lock);
+    pthread_mutex_lock(&stats_lock);
+}
+
+/*
+ * fork_parent - releases the locks fork_prepare() took once fork() returns in
+ * the parent.
+ */
+static void fork_parent() {
+    pthread_mutex_unlock(&stats_lock);
+    pthread_mutex_unlock(&pagemap_lock);
+    pthread_mutex_unlock(&sbrk_lock);
+    for (size_t arena_id = MAX_ARENAS; arena_id-- > 0; ) {
+        pthread_mutex_unlock(&arenas[arena_id].lock);
     }
+}
 
-    if (!free_head) {
-        free_head = write_to;
-        free_head->next = NULL;
-        free_head->prev = NULL;
-        return write_to;
+/*
+ * fork_child - resets the locks in the child, where the forking thread is the
+ * only one left.
+ */
+static void fork_child() {
+    pthread_mutex_init(&stats_lock, NULL);
+    pthread_mutex_init(&pagemap_lock, NULL);
+    pthread_mutex_init(&sbrk_lock, NULL);
+    for (size_t arena_id = 0; arena_id < MAX_ARENAS; arena_id++) {
+        pthread_mutex_init(&arenas[arena_id].lock, NULL);
     }
+}
+
+static void register_fork_handlers() {
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
 
-    memory_block_t * lt_previously_free = write_to == block ? last : write_to;
-    memory_block_t * rt_previously_free = last == block ? write_to : last;
-    assert(lt_previously_free);
-    assert(rt_previously_free);
+/*
+ * clamp_pages - rounds a byte count of the heap tunables up to whole pages,
+ * at least one and at most limit, which must be a multiple of PAGESIZE.
+ */
+static size_t clamp_pages(size_t size, size_t limit) {
+    size = size < limit ? size : limit;
+    size = (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    return size > PAGESIZE ? size : PAGESIZE;
+}
 
-    if (write_to < free_head) {
-        assert(free_head == last);
-        free_head = write_to;
+/*
+ * uinit_config - Used to initialize metadata required to manage the heap
+ * along with allocating initial memory, with the given tunables.
+ */
+int uinit_config(const umalloc_config_t *config) {
+    pthread_once(&fork_handlers_once, register_fork_handlers);
+    mmap_threshold = config && config->mmap_threshold ? config->mmap_threshold : DEFAULT_MMAP_THRESHOLD;
+    trim_threshold = config && config->trim_threshold ? config->trim_threshold : DEFAULT_TRIM_THRESHOLD;
+    defer_coalescing = config && config->defer_coalescing;
+    initial_heap = config && config->initial_heap ? config->initial_heap : DEFAULT_INITIAL_HEAP;
+    min_chunk = config && config->min_chunk ? config->min_chunk : DEFAULT_MIN_CHUNK;
+    max_chunk = config && config->max_chunk ? config->max_chunk : DEFAULT_MAX_CHUNK;
+    // a heap smaller than a page could not even hold its chunk overhead and one block
+    initial_heap = clamp_pages(initial_heap, CSBRK_LIMIT);
+    max_chunk = clamp_pages(max_chunk, CSBRK_LIMIT);
+    min_chunk = clamp_pages(min_chunk, max_chunk);
+    // mmapped blocks outlive a new heap, so their live counts carry over
+    stats.mmap_peak_bytes = stats.mmap_bytes;
+    stats.mmap_total = 0;
+    stats.csbrk_calls = 0;
+    stats.csbrk_avoided = 0;
+    stats.footprint = stats.mmap_bytes;
+    stats.peak_footprint = stats.footprint;
+    pthread_mutex_lock(&stats_lock);
+    memset(&retired_counters, 0, sizeof(retired_counters));
+    memset(&thread_stats.counters, 0, sizeof(thread_stats.counters));
+    for (thread_stats_t *thread = thread_stats_list; thread; thread = thread->next) {
+        memset(&thread->counters, 0, sizeof(thread->counters));
     }
+    pthread_mutex_unlock(&stats_lock);
 
-    set_size(write_to, new_size);
-    write_to->prev = lt_previously_free->prev;
-    if (write_to->prev) {
-        write_to->prev->next = write_to;
+    for (size_t arena_id = 0; arena_id < MAX_ARENAS; arena_id++) {
+        for (size_t class = 0; class < NUM_SIZE_CLASSES; class++) {
+            arenas[arena_id].free_lists[class] = NULL;
+        }
+        arenas[arena_id].nonempty_classes = 0;
+        arenas[arena_id].large_tree = NULL;
+        arenas[arena_id].chunks = NULL;
+        arenas[arena_id].heap_bytes = 0;
+        arenas[arena_id].growth_streak = 0;
+        arenas[arena_id].trim_at = trim_threshold;
+        arenas[arena_id].released = false;
+        for (size_t class = 0; class < NUM_SLAB_CLASSES; class++) {
+            arenas[arena_id].slabs[class] = NULL;
+        }
+        arenas[arena_id].num_deferred = 0;
     }
-    write_to->next = rt_previously_free->next;
-    if (write_to->next) {
-        write_to->next->prev = write_to;
+    for (pagemap_leaf_t *leaf = pagemap_leaves; leaf; leaf = leaf->next) {
+        memset(leaf->bits, 0, sizeof(leaf->bits));
     }
-
-    // write_to->prev_adjacent = write_to->prev_adjacent
-    // set has_preceeding(write_to) to has_preceeding(write_to)
-    // set has_proceeding(write_to) to has_proceeding(last)
-    if (has_proceeding(last)) {
-        set_exists_proceeding(write_to);
-        memory_block_t *last_proceeding = get_proceeding(last);
-        assert(is_allocated(last_proceeding));
-
-        assert(has_preceeding(last_proceeding));
-        last_proceeding->prev_adjacent = write_to;
+    // blocks cached by this thread belonged to the previous heap
+    for (size_t class = 0; class < NUM_SMALL_CLASSES; class++) {
+        tcache.entries[class] = NULL;
+        tcache.counts[class] = 0;
     }
-    else {
-        set_no_proceeding(write_to);
+    next_arena = 0;
+    thread_arena = NULL;
+
+    // the other arenas get their first chunk when a thread first allocates from them
+    memory_block_t *initial = add_chunk(get_thread_arena(), ALIGN(initial_heap));
+    if (!initial) {
+        return -1;
     }
-    return write_to;
+    insert_free_block_no_context(initial);
+    return 0;
 }
 
-
-
 /*
  * uinit - Used initialize metadata required to manage the heap
  * along with allocating initial memory.
  */
 int uinit() {
     //* STUDENT TODO
-    size_t request = PAGESIZE << 3;
-    free_head = csbrk(request);
-    size_t payload_size = request - get_min_padded_size(0, sizeof(memory_block_t));
-    put_block(free_head, payload_size, false);
-    set_no_preceeding(free_head);
-    set_no_proceeding(free_head);
-    return 0;
+    return uinit_config(NULL);
 }
 
 /*
@@ -508,8 +1916,43 @@ int uinit() {
  */
 void *umalloc(size_t size) {
     //* STUDENT TODO
-    memory_block_t * block = find(size);
+    if (size <= SLAB_LIMIT) {
+        size_t class = get_slab_class(size);
+        void *payload = tcache_get(class);
+        if (!payload) {
+            arena_t *arena = lock_thread_arena();
+            payload = slab_alloc(class);
+            pthread_mutex_unlock(&arena->lock);
+        }
+        if (payload) {
+            count_alloc(size, (class + 1) * ALIGNMENT);
+        }
+        return payload;
+    }
+    if (size > MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memory_block_t * block = NULL;
+    if (size < mmap_threshold) {
+        size_t padded_size = BLOCK_SIZE(size) - HEADER_SIZE;
+        if (padded_size < SMALL_CLASS_LIMIT) {
+            void *payload = tcache_get(get_size_class(padded_size));
+            if (payload) {
+                count_alloc(size, padded_size);
+                return payload;
+            }
+        }
+        arena_t *arena = lock_thread_arena();
+        block = find(size);
+        pthread_mutex_unlock(&arena->lock);
+    }
+    // a raised threshold can leave requests too big for a single csbrk chunk
+    if (!block) {
+        block = mmap_alloc(size, ALIGNMENT);
+    }
     if (block) {
+        count_alloc(size, get_size(block));
         return get_payload(block);
     }
     return NULL;
@@ -518,6 +1961,14 @@ void *umalloc(size_t size) {
 /*
  *  STUDENT TODO:
  *      Describe your free block insertion policy.
+ *
+ *  Slab slots are recognised through the pagemap and go back to their slab's bitmap, a slab that empties
+ *  becomes an ordinary free block again. Small blocks and slots first go to the freeing thread's cache, which is served without any lock.
+ *  Everything else goes back to the arena recorded in its header and is coalesced with free neighbors found through the boundary tags and pushed onto
+ *  the front of the list of their size class (LIFO), so a free never walks a list.
+ *  With deferred coalescing selected at init, such blocks are held back still marked allocated instead, handed out again to requests of
+ *  the same size, and coalesced in address order once DEFERRED_LIMIT of them pile up or a request finds nothing listed.
+ *  Blocks that were mmapped on their own are unmapped right away instead.
 */
 
 /*
@@ -527,12 +1978,590 @@ void *umalloc(size_t size) {
 void ufree(void *ptr) {
     //* STUDENT TODO
 
+    slab_t *slab = get_slab(ptr);
+    if (slab) {
+        count_free(slab->slot_size);
+        if (!tcache_put(ptr, slab->slab_class)) {
+            free_to_slab(slab, ptr);
+        }
+        return;
+    }
+
     memory_block_t * new_free = get_block(ptr);
 
     assert(is_allocated(new_free));
-    deallocate(new_free);
+    size_t size = get_size(new_free);
+    count_free(size);
+    if (is_mmapped(new_free)) {
+        mmap_free(new_free);
+        return;
+    }
+    // blocks shrunk by urealloc can be small enough for a slab class, which the cache keeps for slab slots
+    if (size > SLAB_LIMIT && size < SMALL_CLASS_LIMIT && tcache_put(ptr, get_size_class(size))) {
+        return;
+    }
+
+    free_to_arena(new_free);
+}
+
+/*
+ * umalloc_trim - releases the newest chunks of every arena while they are
+ * entirely free, then walks its chunks under the arena's lock, trimming the
+ * top of the newest one down to pad free bytes and dropping the whole pages
+ * inside all other free blocks. The calling thread's cache is flushed first
+ * so that its blocks can be released too.
+ */
+int umalloc_trim(size_t pad) {
+    tcache_flush();
+    size_t released = 0;
+    for (size_t arena_id = 0; arena_id < num_arenas; arena_id++) {
+        arena_t *arena = &arenas[arena_id];
+        pthread_mutex_lock(&arena->lock);
+        flush_deferred(arena);
+        size_t chunk_bytes;
+        while (arena->chunks && (chunk_bytes = release_chunk(arena, get_first_block(arena->chunks)))) {
+            released += chunk_bytes;
+        }
+        for (heap_chunk_t *chunk = arena->chunks; chunk; chunk = chunk->next) {
+            memory_block_t *block = get_first_block(chunk);
+            while (true) {
+                if (!is_allocated(block)) {
+                    size_t trimmed = chunk == arena->chunks ? trim_top(arena, block, pad) : 0;
+                    // a trimmed top keeps its pad committed
+                    released += trimmed ? trimmed : decommit(block, block, ((void *) block) + get_entire_size(block), PAGESIZE);
+                }
+                if (!has_proceeding(block)) {
+                    break;
+                }
+                block = get_proceeding(block);
+            }
+        }
+        pthread_mutex_unlock(&arena->lock);
+    }
+    return released > 0;
+}
+
+/*
+ * absorb_proceeding - grows an allocated block over its free proceeding
+ * block.
+ */
+static void absorb_proceeding(memory_block_t *block) {
+    memory_block_t *proceeding = get_proceeding(block);
+    assert(is_allocated(block) && !is_allocated(proceeding));
+    remove_free_block(proceeding);
+    set_size(block, get_size(block) + get_entire_size(proceeding));
+    if (has_proceeding(proceeding)) {
+        set_allocated_preceeding(get_proceeding(proceeding));
+    }
+    else {
+        set_no_proceeding(block);
+        set_last_block(block);
+    }
+}
+
+/*
+ * grow_wilderness - grows a block that ends its arena's newest chunk by at
+ * least size bytes when that chunk still ends at the program break, moving
+ * the break with csbrk. Returns false when someone else moved the break.
+ */
+static bool grow_wilderness(memory_block_t *block, size_t size) {
+    arena_t *arena = &arenas[get_arena_id(block)];
+    heap_chunk_t *chunk = arena->chunks;
+    void *chunk_end = ((void *) chunk) + chunk->size;
+    if (has_proceeding(block) || ((void *) block) + get_entire_size(block) != chunk_end - CHUNK_PAD) {
+        return false;
+    }
+    size_t increment = (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    pthread_mutex_lock(&sbrk_lock);
+    void *region = sbrk(0) == chunk_end ? csbrk(increment) : NULL;
+    pthread_mutex_unlock(&sbrk_lock);
+    if (!region || region == (void *) -1) {
+        return false;
+    }
+    assert(region == chunk_end);
+    note_growth(arena, increment);
+    chunk->size += increment;
+    set_size(block, get_size(block) + increment);
+    set_last_block(block);
+    return true;
+}
+
+/*
+ * resize_block - resizes an allocated arena block in place, the lock of its
+ * arena must be held. Shrinking splits off the tail, growing takes over a
+ * free proceeding block and then moves the program break if the block ends
+ * up last in the newest chunk. Returns false when the block must move.
+ */
+static bool resize_block(memory_block_t *block, size_t size) {
+    size_t min_padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size) - HEADER_SIZE;
+    if (get_size(block) < min_padded_size) {
+        size_t old_size = get_size(block);
+        memory_block_t *proceeding = get_proceeding(block);
+        if (proceeding && !is_allocated(proceeding)
+            && (old_size + get_entire_size(proceeding) >= min_padded_size || !has_proceeding(proceeding))) {
+            absorb_proceeding(block);
+        }
+        if (get_size(block) < min_padded_size && !grow_wilderness(block, min_padded_size - get_size(block))) {
+            // give back the absorbed block, a tail too small to split stays
+            split(block, old_size);
+            return false;
+        }
+    }
+    split(block, min_padded_size);
+    return true;
+}
+
+/*
+ * mremap_block - resizes an mmapped block, letting the kernel move its pages
+ * instead of copying them. The block keeps its offset into the first page.
+ */
+static memory_block_t *mremap_block(memory_block_t *block, size_t size) {
+    void *old_region = mmap_region(block);
+    size_t old_length = mmap_length(block);
+    size_t offset = ((void *) block) - old_region;
+    size_t length = (offset + BLOCK_SIZE(size) + CHUNK_PAD + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    if (length == old_length) {
+        return block;
+    }
+    void *region = mremap(old_region, old_length, length, MREMAP_MAYMOVE);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    block = region + offset;
+    block->block_size_alloc = (length - offset - CHUNK_PAD) | MMAPPED_BIT | 0x1;
+    if (length > old_length) {
+        add_mmap_bytes(length - old_length);
+    }
+    else {
+        __atomic_sub_fetch(&stats.mmap_bytes, old_length - length, __ATOMIC_RELAXED);
+        shrink_footprint(old_length - length);
+    }
+    return block;
+}
+
+/*
+ * urealloc - changes the size of the allocation at ptr to size bytes, in place
+ * whenever possible, and only copies into a new allocation as a last resort.
+ */
+void *urealloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return umalloc(size);
+    }
+    if (size == 0) {
+        ufree(ptr);
+        return NULL;
+    }
+    if (size > MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t old_size;
+    slab_t *slab = get_slab(ptr);
+    if (slab) {
+        if (size <= slab->slot_size) {
+            return ptr;
+        }
+        old_size = slab->slot_size;
+    }
+    else {
+        memory_block_t *block = get_block(ptr);
+        assert(is_allocated(block));
+        old_size = get_size(block);
+        if (is_mmapped(block)) {
+            if (size >= mmap_threshold) {
+                block = mremap_block(block, size);
+                if (!block) {
+                    return NULL;
+                }
+                count_resize(old_size, get_size(block));
+                return get_payload(block);
+            }
+        }
+        else if (size < mmap_threshold) {
+            arena_t *arena = &arenas[get_arena_id(block)];
+            pthread_mutex_lock(&arena->lock);
+            bool resized = resize_block(block, size);
+            size_t new_size = get_size(block);
+            pthread_mutex_unlock(&arena->lock);
+            // even a failed grow can leave the block a little larger
+            count_resize(old_size, new_size);
+            if (resized) {
+                return ptr;
+            }
+        }
+    }
+
+    void *moved = umalloc(size);
+    if (!moved) {
+        return NULL;
+    }
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    ufree(ptr);
+    return moved;
+}
+
+/*
+ * ucalloc - allocates zeroed memory for an array. A block carved from memory
+ * that is still zero since csbrk returned it only needs its free list links
+ * and footer cleared, everything else is cleared with memset, which is
+ * vectorized by the C library.
+ */
+void *ucalloc(size_t nmemb, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(nmemb, size, &total) || total > MAX_REQUEST) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // fresh mappings are zero already
+    if (total >= mmap_threshold) {
+        memory_block_t *block = mmap_alloc(total, ALIGNMENT);
+        if (!block) {
+            return NULL;
+        }
+        count_alloc(total, get_size(block));
+        return get_payload(block);
+    }
+    size_t padded_size = BLOCK_SIZE(total < MIN_PAYLOAD ? MIN_PAYLOAD : total) - HEADER_SIZE;
+    if (total <= SLAB_LIMIT) {
+        void *payload = umalloc(total);
+        return payload ? memset(payload, 0, total) : NULL;
+    }
+    if (padded_size < SMALL_CLASS_LIMIT) {
+        void *payload = tcache_get(get_size_class(padded_size));
+        if (payload) {
+            count_alloc(total, padded_size);
+            return memset(payload, 0, total);
+        }
+    }
+
+    arena_t *arena = lock_thread_arena();
+    memory_block_t *block = find_fit(padded_size);
+    bool zeroed = false;
+    if (block) {
+        zeroed = is_zeroed(block);
+        split(block, padded_size);
+    }
+    pthread_mutex_unlock(&arena->lock);
+    if (!block) {
+        block = mmap_alloc(total, ALIGNMENT);
+        if (!block) {
+            return NULL;
+        }
+        count_alloc(total, get_size(block));
+        return get_payload(block);
+    }
+    count_alloc(total, get_size(block));
+    void *payload = get_payload(block);
+    if (!zeroed) {
+        return memset(payload, 0, total);
+    }
+    // the links (or tree fields) sit at the front and the footer in the last word, which is ours when the block was not split
+    size_t links = sizeof(tree_node_t) - HEADER_SIZE;
+    memset(payload, 0, links < get_size(block) ? links : get_size(block));
+    memset(payload + get_size(block) - sizeof(size_t), 0, sizeof(size_t));
+    return payload;
+}
+
+/*
+ * umemalign - allocates size bytes whose address is a multiple of alignment.
+ * Alignments up to the slab header size are met by slab slots whose size is a
+ * multiple of the alignment, bigger ones carve an aligned block out of a free
+ * block and hand the slack in front of it back to the free lists.
+ */
+void *umemalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return umalloc(size);
+    }
+    // rounding up to the alignment, or adding the slack in front, must not wrap
+    if (alignment > MAX_REQUEST || size > MAX_REQUEST - alignment) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t slot_size = ((size ? size : 1) + alignment - 1) & ~(alignment - 1);
+    if (alignment <= SLAB_HEADER_SIZE && slot_size <= SLAB_LIMIT) {
+        return umalloc(slot_size);
+    }
+    memory_block_t *block = NULL;
+    // the arena may have to make room for the worst case slack in front of the block
+    if (size + alignment < mmap_threshold) {
+        arena_t *arena = lock_thread_arena();
+        block = find_aligned(size, alignment);
+        pthread_mutex_unlock(&arena->lock);
+    }
+    if (!block) {
+        block = mmap_alloc(size, alignment);
+    }
+    if (!block) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    count_alloc(size, get_size(block));
+    return get_payload(block);
+}
+
+/*
+ * uposix_memalign - posix_memalign() on top of umemalign(), the alignment must
+ * also be a multiple of the size of a pointer.
+ */
+int uposix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    void *payload = umemalign(alignment, size);
+    if (!payload) {
+        return ENOMEM;
+    }
+    *memptr = payload;
+    return 0;
+}
+
+/*
+ * ualigned_alloc - aligned_alloc() on top of umemalign().
+ */
+void *ualigned_alloc(size_t alignment, size_t size) {
+    return umemalign(alignment, size);
+}
+
+/*
+ * carve_batch - cuts up to count allocated blocks of entire_size bytes off the
+ * front of a listed free block in one go, touching the free lists only to
+ * take the block off and to file what is left of it. Returns how many blocks
+ * were carved, their payloads are stored in out.
+ */
+static size_t carve_batch(memory_block_t *block, size_t entire_size, size_t count, void **out) {
+    size_t total_space = get_entire_size(block);
+    size_t carved = total_space / entire_size < count ? total_space / entire_size : count;
+    size_t left = total_space - carved * entire_size;
+    size_t arena_id = get_arena_id(block);
+    bool had_preceeding = has_preceeding(block);
+    bool had_proceeding = has_proceeding(block);
+    bool zeroed = is_zeroed(block);
+    assert(carved > 0);
+
+    remove_free_block(block);
+    // a leftover too small to stand as a free block goes to the last block carved
+    if (left < MIN_BLOCK_SIZE) {
+        left = 0;
+    }
+    memory_block_t *cur = block;
+    for (size_t i = 0; i < carved; i++) {
+        size_t size = i == carved - 1 && !left ? total_space - i * entire_size : entire_size;
+        cur->block_size_alloc = size | 0x1;
+        set_arena_id(cur, arena_id);
+        if (i > 0 || had_preceeding) {
+            set_exists_preceeding(cur);
+        }
+        if (i < carved - 1 || left || had_proceeding) {
+            set_exists_proceeding(cur);
+        }
+        out[i] = get_payload(cur);
+        cur = ((void *) cur) + size;
+    }
+    if (left) {
+        put_block(cur, left - HEADER_SIZE, false);
+        set_arena_id(cur, arena_id);
+        set_zeroed(cur, zeroed);
+        set_exists_preceeding(cur);
+        if (had_proceeding) {
+            set_exists_proceeding(cur);
+        }
+        coalesce(cur);
+    }
+    else if (had_proceeding) {
+        set_allocated_preceeding(cur);
+    }
+    else {
+        set_last_block(out[carved - 1] - HEADER_SIZE);
+    }
+    return carved;
+}
+
+/*
+ * umalloc_batch - allocates up to n blocks of size bytes into out and returns
+ * how many it got, which is less than n only when memory runs out. The
+ * calling thread's cache is drained first, then slabs or listed free blocks
+ * are cut up under a single lock, preferring one big enough for the rest. The
+ * heap only grows for what the listed blocks cannot hold.
+ */
+size_t umalloc_batch(size_t size, size_t n, void **out) {
+    size_t done = 0;
+    if (size > MAX_REQUEST) {
+        errno = ENOMEM;
+        return 0;
+    }
+    if (size >= mmap_threshold) {
+        for (; done < n; done++) {
+            memory_block_t *block = mmap_alloc(size, ALIGNMENT);
+            if (!block) {
+                break;
+            }
+            count_alloc(size, get_size(block));
+            out[done] = get_payload(block);
+        }
+        return done;
+    }
+    size_t padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size) - HEADER_SIZE;
+    size_t class = size <= SLAB_LIMIT ? get_slab_class(size) : get_size_class(padded_size);
+    if (size <= SLAB_LIMIT || padded_size < SMALL_CLASS_LIMIT) {
+        while (done < n && (out[done] = tcache_get(class))) {
+            count_alloc(size, size <= SLAB_LIMIT ? (class + 1) * ALIGNMENT : padded_size);
+            done++;
+        }
+    }
+    if (done == n) {
+        return done;
+    }
+    size_t cached = done;
+
+    arena_t *arena = lock_thread_arena();
+    if (size <= SLAB_LIMIT) {
+        while (done < n && (out[done] = slab_alloc(class))) {
+            done++;
+        }
+    }
+    else {
+        size_t entire_size = padded_size + HEADER_SIZE;
+        while (done < n) {
+            // ask for room for the whole rest, but never for more than one large allocation
+            size_t want = (n - done) * entire_size;
+            want = want < mmap_threshold ? want : (mmap_threshold / entire_size) * entire_size;
+            memory_block_t *block = want > entire_size ? find_listed(arena, want - HEADER_SIZE) : NULL;
+            if (!block) {
+                block = find_listed(arena, padded_size);
+            }
+            if (!block && arena->num_deferred) {
+                flush_deferred(arena);
+                continue;
+            }
+            // the heap only grows once no listed block holds even one more allocation
+            if (!block && !(block = extend_hint(want - HEADER_SIZE, NULL))) {
+                break;
+            }
+            done += carve_batch(block, entire_size, n - done, out + done);
+        }
+    }
+    pthread_mutex_unlock(&arena->lock);
+    for (size_t i = cached; i < done; i++) {
+        count_alloc(size, size <= SLAB_LIMIT ? (class + 1) * ALIGNMENT : get_size(get_block(out[i])));
+    }
+    return done;
+}
+
+/*
+ * ufree_batch - frees n pointers at once. The pointers are sorted by address,
+ * which reorders ptrs, so that slots of a slab and neighboring blocks come
+ * together: each run of adjacent blocks is merged into one free block before
+ * a single coalesce, and an arena lock is only retaken when the owner changes.
+ */
+void ufree_batch(void **ptrs, size_t n) {
+    // free_adjacent() merges blocks before their sizes could be counted
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i]) {
+            slab_t *slab = get_slab(ptrs[i]);
+            count_free(slab ? slab->slot_size : get_size(get_block(ptrs[i])));
+        }
+    }
+    qsort(ptrs, n, sizeof(void *), compare_pointers);
+    arena_t *locked = NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (!ptrs[i]) {
+            continue;
+        }
+        slab_t *slab = get_slab(ptrs[i]);
+        memory_block_t *block = slab ? get_block(slab) : get_block(ptrs[i]);
+        if (!slab && is_mmapped(block)) {
+            mmap_free(block);
+            continue;
+        }
+        arena_t *arena = &arenas[get_arena_id(block)];
+        if (arena != locked) {
+            if (locked) {
+                pthread_mutex_unlock(&locked->lock);
+            }
+            pthread_mutex_lock(&arena->lock);
+            locked = arena;
+        }
+        if (slab) {
+            slab_free(slab, ptrs[i]);
+            continue;
+        }
+
+        i += free_adjacent(arena, ptrs + i, n - i) - 1;
+    }
+    if (locked) {
+        pthread_mutex_unlock(&locked->lock);
+    }
+}
+
+#ifdef UMALLOC_DEBUG
+/*
+ * check_sized - makes sure the size handed to ufree_sized() is the one the
+ * allocation was made with, as far as the slab or header can tell.
+ */
+static void check_sized(void *ptr, size_t size) {
+    slab_t *slab = get_slab(ptr);
+    if (slab) {
+        assert(size <= SLAB_LIMIT && get_slab_class(size) == slab->slab_class);
+        return;
+    }
+    memory_block_t *block = get_block(ptr);
+    assert(is_allocated(block));
+    assert(size <= get_size(block));
+    // split() leaves at most SPLIT_THRESHOLD and a header of slack behind a block
+    size_t padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size) - HEADER_SIZE;
+    assert(is_mmapped(block) || get_size(block) < padded_size + HEADER_SIZE + SPLIT_THRESHOLD);
+}
+#endif
 
-    coalesce(new_free);
+/*
+ * ufree_sized - frees ptr, trusting size to be the size it was allocated
+ * with. Slab slots are found through the pagemap and small blocks are cached
+ * under the class of their size without reading the header, so only the
+ * class size is counted as freed.
+ */
+void ufree_sized(void *ptr, size_t size) {
+#ifdef UMALLOC_DEBUG
+    check_sized(ptr, size);
+#endif
+    if (size <= SLAB_LIMIT) {
+        slab_t *slab = get_slab(ptr);
+        if (slab) {
+            count_free(slab->slot_size);
+            if (!tcache_put(ptr, get_slab_class(size))) {
+                free_to_slab(slab, ptr);
+            }
+            return;
+        }
+    }
+    else if (size < mmap_threshold) {
+        size_t padded_size = BLOCK_SIZE(size) - HEADER_SIZE;
+        if (padded_size < SMALL_CLASS_LIMIT && tcache_put(ptr, get_size_class(padded_size))) {
+            // any slack split() left behind the request stays counted until the block leaves the cache
+            count_free(padded_size);
+            return;
+        }
+    }
+    ufree(ptr);
+}
 
-//    insert_free_block_no_context(new_free);
-}
\ No newline at end of file
+/*
+ * umalloc_usable_size - returns how many bytes the allocation at ptr can
+ * hold, its slot size for slab slots and its payload size otherwise.
+ */
+size_t umalloc_usable_size(void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    slab_t *slab = get_slab(ptr);
+    if (slab) {
+        return slab->slot_size;
+    }
+    memory_block_t *block = get_block(ptr);
+    assert(is_allocated(block));
+    return get_size(block);
+}
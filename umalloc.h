@@ -1,29 +1,193 @@
+#ifndef UMALLOC_H
+#define UMALLOC_H
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define ALIGNMENT 16 /* The alignment of all payloads returned by umalloc */
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 #define SPLIT_THRESHOLD 64 /* The amount of extra free space required to warrant splitting a free block */
 
+#define SMALL_CLASS_LIMIT 512 /* Payloads smaller than this get an exact size class, one per ALIGNMENT step, larger ones go in a size ordered tree */
+#define NUM_SMALL_CLASSES (SMALL_CLASS_LIMIT / ALIGNMENT)
+#define NUM_SIZE_CLASSES NUM_SMALL_CLASSES /* At most 64, one bit each in arena_t.nonempty_classes */
+
+#define TCACHE_COUNT 16 /* Freed blocks each thread keeps per exact size class before handing them back to the heap */
+
+#define SLAB_SHIFT 12
+#define SLAB_SIZE (1 << SLAB_SHIFT) /* Bytes in a slab, slabs are aligned to their size so an object finds its slab by masking */
+#define SLAB_LIMIT 256 /* Requests up to this many bytes are served from slabs of fixed size slots instead of blocks */
+#define NUM_SLAB_CLASSES (SLAB_LIMIT / ALIGNMENT) /* One slab class per ALIGNMENT step up to SLAB_LIMIT */
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / ALIGNMENT / 64) /* Enough occupancy bits for the smallest slot size */
+
+#define MAX_ARENAS 64 /* Upper bound on independent heaps, twice the number of online CPUs are used up to this */
+#define DEFERRED_LIMIT 64 /* Frees an arena holds back from coalescing in deferred mode before merging them in bulk */
+#define ARENA_SHIFT 56 /* The owning arena's index lives in the top byte of block_size_alloc */
+#define ARENA_MASK (((size_t) MAX_ARENAS - 1) << ARENA_SHIFT) /* The bits of block_size_alloc holding the arena index */
+#define SIZE_MASK ((((size_t) 1) << ARENA_SHIFT) - ALIGNMENT) /* The bits of block_size_alloc holding the block size */
+#define MAX_REQUEST (SIZE_MASK >> 1) /* Largest request served, the size bits above it leave room for headers, alignment and page rounding */
+#define MMAPPED_BIT (((size_t) 1) << 63) /* Set in block_size_alloc of a block living alone in its own mmapped region */
+#define ZEROED_BIT (((size_t) 1) << 62) /* Set in block_size_alloc of a free block whose payload is zero apart from its links and footer */
+
 /*
  * memory_block_t - Represents a block of memory managed by the heap. The 
  * struct can be left as is, or modified for your design.
  * In the current design bit0 is the allocated bit
  * bit1 is set whenever there is a contiguously adjacent preceeding block (does not specifiy if it is allocated or not)
  * bit2 is set whenever there is a contiguously adjacent proceeding block (does not specifiy if it is allocated or not)
- * bit3 is unused.
- * and the remaining 60 bit represent the size.
+ * bit3 is set whenever the contiguously adjacent preceeding block is free
+ * bits 4 to 55 represent the size of the entire block, header included,
+ * bits 56 to 61 hold the index of the arena whose chunk the block lives in,
+ * bit 62 is set for free blocks that have never been handed out since csbrk returned their memory (known to be zero)
+ * and bit 63 is set for blocks that were mmapped on their own instead of carved from a chunk.
+ * Allocated blocks only carry the block_size_alloc word, prev and next overlay the first
+ * two words of the payload and are only meaningful while the block is free.
+ * Free blocks also carry a footer, a copy of block_size_alloc in the last word of their payload,
+ * which lets the proceeding block find them without a back pointer (boundary tag).
+ * Headers sit 8 bytes before an ALIGNMENT boundary, so each csbrk chunk starts with a heap_chunk_t
+ * followed by CHUNK_PAD bytes of padding and ends with CHUNK_PAD bytes of slack, which point at the chunk's last block.
  */
 typedef struct memory_block_struct {
     size_t block_size_alloc;
-    //next block whether that be allocated or free
+    //free list links, only valid while the block is free
     struct memory_block_struct *prev;
     struct memory_block_struct *next;
-    struct memory_block_struct *prev_adjacent;
 } memory_block_t;
 
+#define HEADER_SIZE offsetof(memory_block_t, prev) /* Bytes in front of every payload */
+#define MIN_BLOCK_SIZE ALIGN(sizeof(memory_block_t) + sizeof(size_t)) /* Header, free list links and footer */
+#define MIN_PAYLOAD (MIN_BLOCK_SIZE - HEADER_SIZE) /* Smallest payload handed out, leaves room for the links and footer once freed */
+#define CHUNK_PAD (ALIGNMENT - HEADER_SIZE) /* Bytes at each end of a csbrk chunk that no block covers */
+#define BLOCK_SIZE(payload) ALIGN((payload) + HEADER_SIZE) /* Entire size of the smallest block holding payload bytes */
+
+/*
+ * tree_node_t - A free block of at least SMALL_CLASS_LIMIT bytes, filed in
+ * its arena's red-black tree keyed on size. Only one block per size is linked
+ * into the tree, the others hang off it on a ring through the block's prev
+ * and next fields, so the tree's fields are only meaningful when in_tree is
+ * set. Like prev and next, the fields overlay the free payload.
+ */
+typedef struct tree_node_struct {
+    memory_block_t block;
+    struct tree_node_struct *parent;
+    struct tree_node_struct *child[2];
+    bool red;
+    bool in_tree;
+} tree_node_t;
+
+/*
+ * heap_chunk_t - Sits at the start of every region an arena gets from csbrk,
+ * chaining the arena's chunks newest first.
+ */
+typedef struct heap_chunk_struct {
+    struct heap_chunk_struct *next;
+    size_t size; /* bytes obtained from csbrk, this struct included */
+} heap_chunk_t;
+
+#define CHUNK_OVERHEAD (sizeof(heap_chunk_t) + 2 * CHUNK_PAD) /* Bytes of a chunk no block covers */
+
+/*
+ * slab_t - Sits at the start of a SLAB_SIZE aligned region carved out of an
+ * arena as one allocated block, which is split into equally sized slots with
+ * no per object header. A set bit in free_slots marks a free slot. Slabs with
+ * at least one free slot are kept on their arena's list for their class.
+ * The slab's block covers its page except for the last HEADER_SIZE bytes, so
+ * that slabs carved back to back tile whole pages.
+ */
+typedef struct slab_struct {
+    struct slab_struct *prev;
+    struct slab_struct *next;
+    uint16_t slab_class;
+    uint16_t slot_size;
+    uint16_t num_slots;
+    uint16_t num_free;
+    uint64_t free_slots[SLAB_BITMAP_WORDS];
+} slab_t;
+
+#define SLAB_HEADER_SIZE ALIGN(sizeof(slab_t)) /* Bytes at the start of a slab before its first slot */
+
+/*
+ * umalloc_config_t - Tunables passed to uinit_config(), fields left 0 keep
+ * their default.
+ */
+typedef struct umalloc_config_struct {
+    size_t mmap_threshold; /* Requests of at least this many bytes get a private mmapped region */
+    size_t trim_threshold; /* Free blocks this large give memory back to the OS, a free top block is cut down to half of it, doubles per arena when memory given back is needed again */
+    bool defer_coalescing; /* Hold freed blocks back for reuse at the same size and only coalesce them in bulk */
+    size_t initial_heap; /* Bytes uinit_config() takes from csbrk up front, rounded up to whole pages */
+    size_t min_chunk; /* Fewest bytes an arena grows by, rounded up to whole pages */
+    size_t max_chunk; /* Most bytes an arena grows by ahead of need, rounded up to whole pages, at most the csbrk limit */
+} umalloc_config_t;
+
+#define STATS_CLASSES (NUM_SIZE_CLASSES + 1) /* Request sizes counted per ALIGNMENT step below SMALL_CLASS_LIMIT, then all larger together */
+#define STATS_SEARCH_BUCKETS 8 /* Search lengths counted as 0, 1, 2-3, 4-7, ... and 64 or more */
+
+/*
+ * umalloc_counters_t - Counters every thread keeps its own share of, summed
+ * over all threads by umalloc_stats(). All fields are size_t so the shares can
+ * be summed word by word. Allocations that urealloc() moves count as an
+ * allocation and a free.
+ */
+typedef struct umalloc_counters_struct {
+    size_t malloc_calls; /* allocations handed out, a batch counts each block */
+    size_t free_calls; /* allocations given back */
+    size_t class_allocs[STATS_CLASSES]; /* allocations by requested size */
+    size_t search_lengths[STATS_SEARCH_BUCKETS]; /* free blocks and tree nodes looked at per free list search */
+    size_t splits; /* free blocks cut in two */
+    size_t coalesces; /* free blocks merged with a free neighbor */
+    size_t bytes_in_use; /* usable bytes of live allocations */
+} umalloc_counters_t;
+
+/*
+ * umalloc_stats_t - A snapshot of the allocator's counters, filled in by
+ * umalloc_stats().
+ */
+typedef struct umalloc_stats_struct {
+    size_t mmap_count; /* mmapped blocks currently live */
+    size_t mmap_bytes; /* bytes currently mapped for them */
+    size_t mmap_peak_bytes; /* most bytes ever mapped for them at once */
+    size_t mmap_total; /* mmapped blocks handed out since uinit */
+    size_t csbrk_calls; /* csbrk calls that grew the heap since uinit */
+    size_t csbrk_avoided; /* further calls growing by min_chunk at a time would have taken */
+    size_t footprint; /* bytes currently obtained from csbrk and mmap */
+    size_t peak_footprint; /* most bytes ever obtained at once */
+    umalloc_counters_t counters;
+} umalloc_stats_t;
+
+/*
+ * arena_t - An independent heap with its own lock, segregated free lists, a
+ * tree of large free blocks and chunks. Threads are spread over arenas round
+ * robin and move to another arena when theirs is contended, blocks are always
+ * freed into the arena recorded in their header. Bit c of nonempty_classes is
+ * set exactly when free_lists[c] is non-empty. In deferred coalescing mode
+ * deferred holds the payloads of freed blocks that are still marked allocated.
+ * heap_bytes and growth_streak drive how much the arena grows by next, trim_at
+ * is its own trim threshold, doubled whenever it grows again after released
+ * is set by giving memory back on a free.
+ */
+typedef struct arena_struct {
+    pthread_mutex_t lock;
+    memory_block_t *free_lists[NUM_SIZE_CLASSES];
+    uint64_t nonempty_classes;
+    tree_node_t *large_tree;
+    heap_chunk_t *chunks;
+    size_t heap_bytes;
+    size_t growth_streak;
+    size_t trim_at;
+    bool released;
+    slab_t *slabs[NUM_SLAB_CLASSES];
+    void *deferred[DEFERRED_LIMIT];
+    size_t num_deferred;
+} arena_t;
+
 // Helper Functions, this may be editted if you change the signature in umalloc.c
 
 /*
@@ -48,7 +212,13 @@ bool has_preceeding(memory_block_t *block);
 bool has_proceeding(memory_block_t *block);
 
 /*
-    @Description: returns the preceeding contiguously adjascent block to a given block
+    @Description: returns if the contiguously adjacent preceeding block is free, which means its footer can be read
+*/
+bool has_free_preceeding(memory_block_t *block);
+
+/*
+    @Description: returns the preceeding contiguously adjascent block to a given block if it is free, found through its footer,
+        returns NULL when there is no preceeding block or it is allocated
 */
 memory_block_t *get_preceeding(memory_block_t *block);
 /*
@@ -57,6 +227,20 @@ memory_block_t *get_preceeding(memory_block_t *block);
 memory_block_t *get_proceeding(memory_block_t *block);
 
 
+/*
+    @Description: returns if a block lives alone in a region of its own obtained from mmap rather than in an arena's chunk
+*/
+bool is_mmapped(memory_block_t *block);
+/*
+    @Description: returns if a free block is known to be zero apart from its free list links and footer,
+        because its memory came straight from csbrk and was never handed out
+*/
+bool is_zeroed(memory_block_t *block);
+/*
+    @Description: records within block_size_alloc whether a free block is known to be zero apart from its links and footer
+*/
+void set_zeroed(memory_block_t *block, bool zeroed);
+
 /*
     @Description: set a memory block to the status of being allocated
         when a free block is to be put into use call this and pass said block
@@ -85,9 +269,47 @@ void set_exists_proceeding(memory_block_t *block);
     @Description: records within block_size_alloc that a given memory block has no contiguously adjacent proceeding block
 */
 void set_no_proceeding(memory_block_t *block);
+/*
+    @Description: records within block_size_alloc that the contiguously adjacent preceeding block is free
+*/
+void set_free_preceeding(memory_block_t *block);
+/*
+    @Description: records within block_size_alloc that the contiguously adjacent preceeding block is allocated
+*/
+void set_allocated_preceeding(memory_block_t *block);
+/*
+    @Description: write the boundary tag of a free block, a copy of its header in the last word of its payload,
+        and mark the proceeding block as having a free preceeding block or record the block as the last of its chunk
+*/
+void put_footer(memory_block_t *block);
+
+/*
+    @Description: return the index of the arena that owns a given memory_block_t, recorded in its header
+*/
+size_t get_arena_id(memory_block_t *block);
+/*
+    @Description: record within block_size_alloc the index of the arena that owns a given memory_block_t
+*/
+void set_arena_id(memory_block_t *block, size_t arena_id);
+/*
+    @Description: return the arena the calling thread allocates from, assigning one round robin on first use
+*/
+arena_t *get_thread_arena();
+/*
+    @Description: return the first block of a chunk, right after its heap_chunk_t and padding
+*/
+memory_block_t *get_first_block(heap_chunk_t *chunk);
+/*
+    @Description: return the last block of a chunk, recorded in the chunk's slack
+*/
+memory_block_t *get_last_block(heap_chunk_t *chunk);
+/*
+    @Description: record a block without a proceeding block as the last of its chunk, in the slack right behind it
+*/
+void set_last_block(memory_block_t *block);
 
 /*
-    @Description: return the size of the payload of a given memory_block_t struct
+    @Description: return the size of the payload of a given memory_block_t struct, the entire block minus its header
 */
 size_t get_size(memory_block_t *block);
 /*
@@ -100,7 +322,8 @@ memory_block_t *get_next(memory_block_t *block);
 memory_block_t *get_prev(memory_block_t *block);
 /*
     @Description: initialize a new memory_block_t at a given address,
-        initialize it with (size, alloc) and set the next block pointer appropriately
+        initialize it with (size, alloc) where size is the payload size and size + HEADER_SIZE is a multiple of ALIGNMENT,
+        and set the next block pointer appropriately
 */
 void put_block(memory_block_t *block, size_t size, bool alloc);
 /*
@@ -124,22 +347,38 @@ size_t get_min_padded_size(size_t payload_size, size_t type_size);
 */
 size_t get_entire_size(memory_block_t * block);
 /*
-    @Description: add a free block to the free list without any hints as to where it may fit
+    @Description: map a payload size to the index of the segregated free list that holds blocks of that size,
+        sizes below SMALL_CLASS_LIMIT map to an exact class, larger sizes to NUM_SIZE_CLASSES as they are kept in the large block tree
+*/
+size_t get_size_class(size_t size);
+/*
+    @Description: add a free block to the front of the free list of its size class (LIFO) in constant time,
+        or into its arena's large block tree in logarithmic time
 */
 void insert_free_block_no_context(memory_block_t *block);
 /*
-    @Description: add a block into the free block list, provide a hint as to the previous free block
+    @Description: add a block into the free list of its size class directly after hint when hint belongs to the same class,
+        otherwise at the front of the list
 */
 void insert_free_block_hint(memory_block_t *new_free, memory_block_t *hint);
+/*
+    @Description: return the smallest block in an arena's large block tree with a payload of at least size bytes, NULL if there is none
+*/
+memory_block_t *tree_best_fit(arena_t *arena, size_t size);
+/*
+    @Description: unlink a free block from the free list of its size class or from the large block tree,
+        must be called before the block's size changes
+*/
+void remove_free_block(memory_block_t *block);
 
 /*
-    @Description: return a memory_block_t of sufficient size to satisfy a malloc request of a given size
+    @Description: return a memory_block_t of sufficient size to satisfy a malloc request of a given size from the calling thread's arena,
+        searching the request's own size class first, then the first non-empty larger class and then the best fit in the large block tree
 */
 memory_block_t *find(size_t size);
 /*
     @Description: In the event that more memory is needed to satisfy malloc requests
-        extend() may be called to increase the size of the heap,
-        this version finds last sbrk_block_t in list and calls extend_pass_sbrk()
+        extend() may be called to add a chunk to the calling thread's arena
 */
 memory_block_t *extend(size_t size);
 
@@ -152,16 +391,134 @@ memory_block_t *extend(size_t size);
 memory_block_t *extend_hint(size_t size, memory_block_t * hint);
 
 /*
-    @Description: divide a free block into two sections, one allocated block, and the remaining space free
+    @Description: divide a free block into two sections, one allocated block, and the remaining space free,
+        the block must be on its free list or already allocated, the remainder is coalesced and filed under its own size class
 */
 memory_block_t *split(memory_block_t *block, size_t size);
 /*
-    @Description: combine a free block with adjacent free blocks to create one larger free block
+    @Description: combine a free block with adjacent free blocks to create one larger free block,
+        the block must not be on a free list yet, the merged block is inserted into the list for its new size class
 */
 memory_block_t *coalesce(memory_block_t *block);
 
+/*
+    @Description: map a request of at most SLAB_LIMIT bytes to its slab class, slots of class c hold (c + 1) * ALIGNMENT bytes
+*/
+size_t get_slab_class(size_t size);
+/*
+    @Description: return the slab a pointer was handed out from, or NULL when it belongs to an ordinary block,
+        answered from a bitmap over every SLAB_SIZE page of the address space without touching the pointer
+*/
+slab_t *get_slab(void *ptr);
+/*
+    @Description: take a free slot of the given slab class from the calling thread's arena,
+        carving a new slab out of the arena when no slab of that class has a free slot, the arena lock must be held
+*/
+void *slab_alloc(size_t slab_class);
+/*
+    @Description: mark a slot of a slab free again, the lock of the arena owning the slab must be held,
+        a slab that becomes empty is handed back to the arena as a free block unless it is the last one of its class
+*/
+void slab_free(slab_t *slab, void *ptr);
+
+/*
+    @Description: map a region of its own for a large request and return the allocated block at its start,
+        with its payload on a multiple of alignment, a power of two of at least ALIGNMENT,
+        the region is unmapped again as soon as the block is freed, returns NULL when mmap fails
+*/
+memory_block_t *mmap_alloc(size_t size, size_t alignment);
+/*
+    @Description: unmap the region of a block returned by mmap_alloc()
+*/
+void mmap_free(memory_block_t *block);
+
+/*
+    @Description: pop a payload of the given class off the calling thread's cache without taking an arena lock,
+        classes below NUM_SLAB_CLASSES are slab classes and the rest are exact block size classes,
+        returns NULL when the cache for that class is empty
+*/
+void *tcache_get(size_t size_class);
+/*
+    @Description: push a small payload that is being freed onto the calling thread's cache for its class,
+        returns false when the cache for that class is full and the payload must go back to its slab or arena
+*/
+bool tcache_put(void *payload, size_t size_class);
+/*
+    @Description: free every payload held in the calling thread's cache back into the heap,
+        runs automatically when a thread exits
+*/
+void tcache_flush();
+
+
+/*
+    @Description: initialize the heap like uinit() with the tunables in config, a NULL config or 0 fields keep the defaults
+*/
+int uinit_config(const umalloc_config_t *config);
+/*
+    @Description: fill stats with a snapshot of the allocator's counters, summing the per-thread counters of all live and exited threads,
+        which costs a lock and a pass over the threads but keeps the counters off every other path's critical section
+*/
+void umalloc_stats(umalloc_stats_t *stats);
+/*
+    @Description: give free memory back to the OS, shrinking each arena's heap down to pad free bytes at its top when it ends at the break
+        and dropping the whole pages inside every other free block, returns 1 if any memory was released and 0 otherwise
+*/
+int umalloc_trim(size_t pad);
+/*
+    @Description: resize the allocation at ptr to size bytes keeping its contents, returns the possibly moved payload,
+        shrinks in place and grows in place over a free proceeding block or the end of the heap before falling back to a copy,
+        behaves like umalloc() for a NULL ptr and like ufree() for a size of 0, returns NULL and leaves ptr intact on failure
+*/
+void *urealloc(void *ptr, size_t size);
+/*
+    @Description: allocate zeroed memory for an array of nmemb elements of size bytes each, returns NULL if the total overflows or exceeds MAX_REQUEST,
+        only clears the bytes that may have been used before, memory fresh from csbrk or mmap is already zero
+*/
+void *ucalloc(size_t nmemb, size_t size);
+/*
+    @Description: allocate size bytes at an address that is a multiple of alignment, which must be a power of two,
+        returns NULL and sets errno when the alignment is invalid or memory runs out, the result is freed with ufree()
+*/
+void *umemalign(size_t alignment, size_t size);
+/*
+    @Description: store in memptr an allocation of size bytes aligned like umemalign(), the alignment must also be a multiple of sizeof(void *),
+        returns 0 on success, EINVAL for a bad alignment or ENOMEM when memory runs out and leaves memptr untouched on failure
+*/
+int uposix_memalign(void **memptr, size_t alignment, size_t size);
+/*
+    @Description: allocate size bytes aligned like umemalign(), the C11 aligned_alloc() counterpart
+*/
+void *ualigned_alloc(size_t alignment, size_t size);
+/*
+    @Description: allocate up to n blocks of size bytes each into out, returns how many were allocated, fewer than n only when memory runs out,
+        blocks are carved out of as few free blocks as possible under a single lock,
+        the heap only grows once no free block holds another one
+*/
+size_t umalloc_batch(size_t size, size_t n, void **out);
+/*
+    @Description: free n pointers at once, NULL entries are skipped and ptrs is sorted by address in the process,
+        runs of adjacent blocks are merged before a single coalesce
+*/
+void ufree_batch(void **ptrs, size_t n);
+/*
+    @Description: free ptr knowing it was allocated by umalloc(), ucalloc() or urealloc() with exactly size bytes,
+        routes small sizes to their slab or cached size class without reading the block header,
+        so the statistics count the size class as freed and catch up on any slack when the block leaves the cache,
+        builds with UMALLOC_DEBUG defined check the size against the slab or header
+*/
+void ufree_sized(void *ptr, size_t size);
+/*
+    @Description: return the number of bytes the allocation at ptr can hold, at least what was asked for, 0 for NULL
+*/
+size_t umalloc_usable_size(void *ptr);
 
 // Portion that may not be edited
 int uinit();
 void *umalloc(size_t size);
-void ufree(void *ptr);
\ No newline at end of file
+void ufree(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * umalloc.hpp - C++ allocators over umalloc: a std::pmr::memory_resource,
+ * an STL allocator and pool and monotonic resources. uinit() or
+ * uinit_config() must have run before any of them allocates.
+ **************************************************************************/
+
+#ifndef UMALLOC_HPP
+#define UMALLOC_HPP
+
+#include "umalloc.h"
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+/*
+ * umalloc_resource - A memory resource handing out umalloc() memory. Requests
+ * aligned beyond ALIGNMENT go through umemalign(), and deallocations pass
+ * their size on to ufree_sized() so small blocks never have their header
+ * read. All instances share the one heap, so they compare equal.
+ */
+class umalloc_resource : public std::pmr::memory_resource {
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void *payload = alignment <= ALIGNMENT ? umalloc(bytes) : umemalign(alignment, bytes);
+        if (!payload) {
+            throw std::bad_alloc();
+        }
+        return payload;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+        // umemalign() may round the request up to an aligned slot, which ufree_sized() would not know
+        if (alignment <= ALIGNMENT) {
+            ufree_sized(p, bytes);
+        }
+        else {
+            ufree(p);
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return dynamic_cast<const umalloc_resource *>(&other) != nullptr;
+    }
+};
+
+/*
+ * umalloc_default_resource - returns the process wide umalloc_resource, for
+ * use as the upstream of other resources or with
+ * std::pmr::set_default_resource().
+ */
+inline umalloc_resource *umalloc_default_resource() noexcept {
+    static umalloc_resource resource;
+    return &resource;
+}
+
+/*
+ * umalloc_allocator - An STL allocator over umalloc() and ufree_sized(),
+ * stateless so that containers can swap and splice freely.
+ */
+template <class T>
+struct umalloc_allocator {
+    using value_type = T;
+
+    umalloc_allocator() noexcept = default;
+    template <class U>
+    umalloc_allocator(const umalloc_allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void *payload = alignof(T) <= ALIGNMENT ? umalloc(n * sizeof(T)) : umemalign(alignof(T), n * sizeof(T));
+        if (!payload) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(payload);
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (alignof(T) <= ALIGNMENT) {
+            ufree_sized(p, n * sizeof(T));
+        }
+        else {
+            ufree(p);
+        }
+    }
+};
+
+template <class T, class U>
+bool operator==(const umalloc_allocator<T> &, const umalloc_allocator<U> &) noexcept {
+    return true;
+}
+
+template <class T, class U>
+bool operator!=(const umalloc_allocator<T> &, const umalloc_allocator<U> &) noexcept {
+    return false;
+}
+
+/*
+ * umalloc_pool_resource - An unsynchronized pool for node based containers.
+ * Requests up to SLAB_LIMIT bytes are rounded up to a slab class and served
+ * from a free list per class, refilled UMALLOC_POOL_BATCH slots at a time
+ * with umalloc_batch() and handed back in one ufree_batch() by release() or
+ * the destructor. Larger or over-aligned requests go to the upstream resource.
+ */
+#define UMALLOC_POOL_BATCH 64 /* Slots a pool's free list is refilled with at a time */
+
+class umalloc_pool_resource : public std::pmr::memory_resource {
+public:
+    explicit umalloc_pool_resource(std::pmr::memory_resource *upstream = umalloc_default_resource()) noexcept
+        : upstream(upstream), free_slots() {}
+
+    umalloc_pool_resource(const umalloc_pool_resource &) = delete;
+    umalloc_pool_resource &operator=(const umalloc_pool_resource &) = delete;
+
+    ~umalloc_pool_resource() override {
+        release();
+    }
+
+    /*
+     * release - frees every slot the pool got, whether or not it was
+     * deallocated.
+     */
+    void release() noexcept {
+        ufree_batch(slots.data(), slots.size());
+        slots.clear();
+        for (std::size_t slab_class = 0; slab_class < NUM_SLAB_CLASSES; slab_class++) {
+            free_slots[slab_class] = nullptr;
+        }
+    }
+
+    std::pmr::memory_resource *upstream_resource() const noexcept {
+        return upstream;
+    }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (bytes > SLAB_LIMIT || alignment > ALIGNMENT) {
+            return upstream->allocate(bytes, alignment);
+        }
+        std::size_t slab_class = get_slab_class(bytes);
+        if (!free_slots[slab_class]) {
+            refill(slab_class);
+        }
+        void *slot = free_slots[slab_class];
+        free_slots[slab_class] = *static_cast<void **>(slot);
+        return slot;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+        if (bytes > SLAB_LIMIT || alignment > ALIGNMENT) {
+            upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        std::size_t slab_class = get_slab_class(bytes);
+        *static_cast<void **>(p) = free_slots[slab_class];
+        free_slots[slab_class] = p;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    /*
+     * refill - threads a fresh batch of slots of the class onto its free
+     * list, remembering them for release().
+     */
+    void refill(std::size_t slab_class) {
+        void *batch[UMALLOC_POOL_BATCH];
+        std::size_t got = umalloc_batch((slab_class + 1) * ALIGNMENT, UMALLOC_POOL_BATCH, batch);
+        if (!got) {
+            throw std::bad_alloc();
+        }
+        slots.reserve(slots.size() + got);
+        for (std::size_t i = 0; i < got; i++) {
+            *static_cast<void **>(batch[i]) = free_slots[slab_class];
+            free_slots[slab_class] = batch[i];
+            slots.push_back(batch[i]);
+        }
+    }
+
+    std::pmr::memory_resource *upstream;
+    void *free_slots[NUM_SLAB_CLASSES];
+    std::vector<void *> slots;
+};
+
+/*
+ * umalloc_monotonic_resource - Bumps through buffers taken from the arenas
+ * with umalloc(), each twice the size of the last, and ignores
+ * deallocations. release() or the destructor frees all buffers at once.
+ */
+#define UMALLOC_MONOTONIC_BUFFER 1024 /* Bytes in a monotonic resource's first buffer */
+
+class umalloc_monotonic_resource : public std::pmr::memory_resource {
+public:
+    explicit umalloc_monotonic_resource(std::size_t initial_size = UMALLOC_MONOTONIC_BUFFER) noexcept
+        : next_size(initial_size > sizeof(buffer_t) ? initial_size : UMALLOC_MONOTONIC_BUFFER) {}
+
+    umalloc_monotonic_resource(const umalloc_monotonic_resource &) = delete;
+    umalloc_monotonic_resource &operator=(const umalloc_monotonic_resource &) = delete;
+
+    ~umalloc_monotonic_resource() override {
+        release();
+    }
+
+    /*
+     * release - frees all buffers, the next one taken is as big as the
+     * biggest one was so that a reused resource settles on a single buffer.
+     */
+    void release() noexcept {
+        if (buffers) {
+            next_size = buffers->size;
+        }
+        while (buffers) {
+            buffer_t *next = buffers->next;
+            ufree_sized(buffers, buffers->size);
+            buffers = next;
+        }
+        current = nullptr;
+        left = 0;
+    }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (!std::align(alignment, bytes, current, left)) {
+            grow(bytes + alignment);
+            std::align(alignment, bytes, current, left);
+        }
+        void *payload = current;
+        current = static_cast<char *>(current) + bytes;
+        left -= bytes;
+        return payload;
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    struct buffer_t {
+        buffer_t *next;
+        std::size_t size;
+    };
+
+    /*
+     * grow - starts a new buffer with room for at least bytes after its
+     * header.
+     */
+    void grow(std::size_t bytes) {
+        while (next_size - sizeof(buffer_t) < bytes) {
+            next_size *= 2;
+        }
+        buffer_t *buffer = static_cast<buffer_t *>(umalloc(next_size));
+        if (!buffer) {
+            throw std::bad_alloc();
+        }
+        buffer->next = buffers;
+        buffer->size = next_size;
+        buffers = buffer;
+        current = buffer + 1;
+        left = next_size - sizeof(buffer_t);
+        next_size *= 2;
+    }
+
+    buffer_t *buffers = nullptr;
+    void *current = nullptr;
+    std::size_t left = 0;
+    std::size_t next_size;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #define COMMENT '#'
 #define BLANK '\n'
@@ -15,13 +16,25 @@
 #define EXTEND 'E'
 #define SPLIT 'S'
 #define COALESCE 'C'
+#define SLAB 'L'
+#define REALLOC 'R'
+#define CALLOC 'Z'
+#define MEMALIGN 'A'
+#define BATCH 'B'
+#define SIZED_FREE 'U'
+#define TRIM 'T'
+#define DEFERRED 'D'
+#define GROWTH 'G'
+#define CHUNKS 'K'
+#define HISTOGRAM 'H'
+#define OVERFLOW 'O'
 #define MAX_LINE_LENGTH 160
 
 static char printbuf[MAX_LINE_LENGTH];
 static char linebuf[MAX_LINE_LENGTH];
 static int size_offset;
 static bool check;
-extern memory_block_t *free_head;
+extern arena_t arenas[];
 
 /* A struct for keeping track of test blocks. */
 typedef struct block_record {
@@ -31,15 +44,14 @@ typedef struct block_record {
 
 /* Function interfaces */
 static FILE *read_args(int argc, char **argv);
-static void list_add(record_t **record_table, uint32_t id);
-static void list_remove(record_t **record_table, uint32_t id);
-static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE *infile, size_t num_blocks);
+static void initialize_list(void *heap, record_t **record_table, FILE *infile, size_t num_blocks);
+static void rebuild_free_lists(record_t **record_table, size_t len);
 static void backup_list(record_t **dest, record_t **source, size_t len);
 static void run_tests(record_t **record_table, record_t **backup, size_t len, FILE *infile);
 
 static void print_block(memory_block_t *block);
 // static void print_records(record_t **record_table, size_t len);
-static void print_list(memory_block_t *free_list);
+static void print_lists();
 
 static void run_heap_check();
 static void test_find(size_t size);
@@ -47,6 +59,25 @@ static void test_extend(size_t size);
 static void test_split(record_t **record_table, uint32_t id, size_t size);
 static void test_coalesce(record_t **record_table, uint32_t id);
 
+static void start_heap(const umalloc_config_t *config);
+static void fill_payload(void *payload, size_t size, size_t seed);
+static bool check_payload(void *payload, size_t size, size_t seed);
+static void test_slab(size_t count, size_t size);
+static void test_realloc(size_t size, size_t new_size);
+static void test_calloc(size_t nmemb, size_t size);
+static void test_memalign(size_t alignment, size_t size);
+static void test_batch(size_t count, size_t size);
+static void test_sized_free(size_t count, size_t size);
+static void test_trim(size_t count, size_t size);
+static void test_deferred(size_t count, size_t size);
+static size_t whole_pages(size_t size);
+static void test_growth(size_t initial_heap, size_t min_chunk, size_t max_chunk);
+static void test_chunks(size_t size);
+static size_t count_searches(const umalloc_stats_t *stats, size_t *longest);
+static void test_histogram(size_t count, size_t size);
+static void expect_refused(const char *call, bool refused);
+static void test_overflow();
+
 /* Run all tests */
 int main(int argc, char **argv) {
 
@@ -69,8 +100,10 @@ int main(int argc, char **argv) {
 
     record_t **record_table = (record_t **)calloc(num_blocks, sizeof(record_t *));
     record_t **record_table_copy = (record_t **)calloc(num_blocks, sizeof(record_t *));
-    heap = csbrk(heap_size);
-    free_head = initialize_list(heap, record_table, infile, num_blocks);
+    /* leave room for the padding at either end of a chunk */
+    heap = csbrk(heap_size + CHUNK_OVERHEAD);
+    initialize_list(heap, record_table, infile, num_blocks);
+    rebuild_free_lists(record_table, num_blocks);
 
     for (int i = 0; i < num_blocks; i++) {
         record_table_copy[i] = (record_t *)malloc(sizeof(record_t));
@@ -81,7 +114,7 @@ int main(int argc, char **argv) {
     
     sprintf(printbuf, "Initial free list state:");
     logging(LOG_INFO, printbuf);
-    print_list(free_head);
+    print_lists();
 
     run_heap_check();
 
@@ -103,7 +136,7 @@ static FILE *read_args(int argc, char **argv) {
                 }
                 break;
             case 's':
-                size_offset = sizeof(memory_block_t);
+                size_offset = HEADER_SIZE;
                 break;
             case 'c':
                 check = true;
@@ -122,28 +155,7 @@ static FILE *read_args(int argc, char **argv) {
     return infile;
 }
 
-static void list_add(record_t **record_table, uint32_t id) {
-    memory_block_t *block = NULL;
-    for (int i = 1; i < id; i++) {
-        if (!is_allocated(record_table[i-1]->addr)) {
-            block = record_table[i-1]->addr;
-        }
-    }
-    if (block) block->next = record_table[id-1]->addr;
-}
-
-static void list_remove(record_t **record_table, uint32_t id) {
-    memory_block_t *block = NULL;
-    for (int i = 1; i < id; i++) {
-        if (!is_allocated(record_table[i-1]->addr)) {
-            block = record_table[i-1]->addr;
-        }
-    }
-    if (block) block->next = record_table[id-1]->addr->next;
-}
-
-static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE* infile, size_t num_blocks) {
-    memory_block_t *free_list = NULL;
+static void initialize_list(void *heap, record_t **record_table, FILE* infile, size_t num_blocks) {
     char op;
     uint32_t id;
     size_t size;
@@ -169,8 +181,9 @@ static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE
 
         if (id > id_counter) {
             id_counter++;
-            block = (memory_block_t *)(heap + total_size);
-            total_size += size + sizeof(memory_block_t);
+            /* the first header sits CHUNK_PAD bytes in so that payloads are aligned */
+            block = (memory_block_t *)(heap + CHUNK_PAD + total_size);
+            total_size += BLOCK_SIZE(size + size_offset);
             /* ids are 1-indexed. */
             record_table[id-1] = (record_t *)malloc(sizeof(record_t));
             record_table[id-1]->id = id;
@@ -182,12 +195,10 @@ static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE
 
         switch (op) {
             case ALLOC:
-                list_remove(record_table, id);
-                put_block(block, size + size_offset, true);
+                put_block(block, BLOCK_SIZE(size + size_offset) - HEADER_SIZE, true);
                 break;
             case FREE:
-                list_add(record_table, id);
-                put_block(block, size + size_offset, false);
+                put_block(block, BLOCK_SIZE(size + size_offset) - HEADER_SIZE, false);
                 break;
             default:
                 break;
@@ -195,9 +206,8 @@ static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE
 
         if (id > 1) {
             set_exists_preceeding(block);
-            block->prev_adjacent = record_table[id-2]->addr;
         }
-        if (id <= num_blocks) {
+        if (id < num_blocks) {
             set_exists_proceeding(block);
         }
 
@@ -206,13 +216,30 @@ static memory_block_t *initialize_list(void *heap, record_t **record_table, FILE
             exit(EXIT_FAILURE);
         }
     }
+}
 
-    free_list = record_table[0]->addr;
-    for (int i = 0; is_allocated(free_list); i++) {
-        free_list = record_table[0]->addr;
+/* Rebuild the boundary tags and the segregated free lists from the blocks in the record table. */
+static void rebuild_free_lists(record_t **record_table, size_t len) {
+    for (size_t class = 0; class < NUM_SIZE_CLASSES; class++) {
+        arenas[0].free_lists[class] = NULL;
+    }
+    arenas[0].nonempty_classes = 0;
+    arenas[0].large_tree = NULL;
+    for (int i = 0; i < len; i++) {
+        memory_block_t *block = record_table[i]->addr;
+        if (i > 0 && !is_allocated(record_table[i-1]->addr)) {
+            set_free_preceeding(block);
+        }
+        else {
+            set_allocated_preceeding(block);
+        }
+    }
+    for (int i = 0; i < len; i++) {
+        if (!is_allocated(record_table[i]->addr)) {
+            put_footer(record_table[i]->addr);
+            insert_free_block_no_context(record_table[i]->addr);
+        }
     }
-
-    return free_list;
 }
 
 static void backup_list(record_t **dest, record_t **source, size_t len) {
@@ -224,7 +251,7 @@ static void backup_list(record_t **dest, record_t **source, size_t len) {
 static void run_tests(record_t **record_table, record_t **backup, size_t len, FILE *infile) {
     char op;
     uint32_t id;
-    size_t size;
+    size_t size, new_size, extra;
 
     if (fgets(linebuf, sizeof(linebuf), infile) == NULL) {
         logging(LOG_FATAL, "Could not read from input file.\n");
@@ -257,12 +284,60 @@ static void run_tests(record_t **record_table, record_t **backup, size_t len, FI
                 sscanf(linebuf, "%c %d", &op, &id);
                 test_coalesce(record_table, id);
                 break;
+            case SLAB:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_slab(size, new_size);
+                break;
+            case REALLOC:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_realloc(size, new_size);
+                break;
+            case CALLOC:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_calloc(size, new_size);
+                break;
+            case MEMALIGN:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_memalign(size, new_size);
+                break;
+            case BATCH:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_batch(size, new_size);
+                break;
+            case SIZED_FREE:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_sized_free(size, new_size);
+                break;
+            case TRIM:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_trim(size, new_size);
+                break;
+            case DEFERRED:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_deferred(size, new_size);
+                break;
+            case GROWTH:
+                sscanf(linebuf, "%c %ld %ld %ld", &op, &size, &new_size, &extra);
+                test_growth(size, new_size, extra);
+                break;
+            case CHUNKS:
+                sscanf(linebuf, "%c %ld", &op, &size);
+                test_chunks(size);
+                break;
+            case HISTOGRAM:
+                sscanf(linebuf, "%c %ld %ld", &op, &size, &new_size);
+                test_histogram(size, new_size);
+                break;
+            case OVERFLOW:
+                test_overflow();
+                break;
             default:
                 break;
         }
 
         run_heap_check();
         backup_list(record_table, backup, len);
+        rebuild_free_lists(record_table, len);
 
         if (fgets(linebuf, sizeof(linebuf), infile) == NULL) {
             logging(LOG_FATAL, "Could not read from input file.\n");
@@ -285,11 +360,28 @@ static void print_block(memory_block_t *block) {
 //     }
 // }
 
-static void print_list(memory_block_t *head) {
-    while(head) {
-        print_block(head);
-        head = head->next;
+static void print_tree(tree_node_t *node) {
+    if (!node) {
+        return;
     }
+    print_tree(node->child[0]);
+    memory_block_t *cur = &node->block;
+    do {
+        print_block(cur);
+        cur = cur->next;
+    } while (cur != &node->block);
+    print_tree(node->child[1]);
+}
+
+static void print_lists() {
+    for (size_t class = 0; class < NUM_SIZE_CLASSES; class++) {
+        memory_block_t *head = arenas[0].free_lists[class];
+        while(head) {
+            print_block(head);
+            head = head->next;
+        }
+    }
+    print_tree(arenas[0].large_tree);
     sprintf(printbuf, "End of free list.\n");
     logging(LOG_INFO, printbuf);
 }
@@ -353,6 +445,9 @@ static void test_split(record_t **record_table, uint32_t id, size_t size) {
     memory_block_t *block = record_table[id-1]->addr;
     size_t original_size = get_size(block);
     memory_block_t *original_next = block->next;
+    // split() only carves a free block off when it leaves more than SPLIT_THRESHOLD behind
+    size_t min_padded_size = BLOCK_SIZE(size < MIN_PAYLOAD ? MIN_PAYLOAD : size);
+    bool should_split = min_padded_size + HEADER_SIZE + SPLIT_THRESHOLD <= get_entire_size(block);
 
     sprintf(printbuf, "Testing split on a block with an initial size of %ld:", get_size(block));
     logging(LOG_INFO, printbuf);
@@ -365,7 +460,7 @@ static void test_split(record_t **record_table, uint32_t id, size_t size) {
         sprintf(printbuf, "Split returned NULL.\n");
         logging(LOG_WARNING, printbuf);
     }
-    else if (original_size <= size+2*sizeof(memory_block_t)-size_offset) {
+    else if (!should_split) {
         if (get_size(split_block) == original_size && split_block->next == original_next) {
             sprintf(printbuf, "Block was not split.\n");
             logging(LOG_INFO, printbuf);
@@ -386,9 +481,9 @@ static void test_split(record_t **record_table, uint32_t id, size_t size) {
             sprintf(printbuf, "Block was split.");
             logging(LOG_INFO, printbuf);
             size_t alloc_size = get_size(split_block);
-            split_block = (memory_block_t *)((char *)split_block + sizeof(memory_block_t) - size_offset + alloc_size);
+            split_block = (memory_block_t *)((char *)split_block + HEADER_SIZE - size_offset + alloc_size);
             size_t new_size = get_size(split_block);
-            if (alloc_size >= ALIGN(size) && new_size + alloc_size + sizeof(memory_block_t) - size_offset == original_size) {
+            if (alloc_size >= ALIGN(size) && new_size + alloc_size + HEADER_SIZE - size_offset == original_size) {
                 sprintf(printbuf, "New sizes: %ld free, %ld allocated.\n", new_size, alloc_size);
                 logging(LOG_INFO, printbuf);
             }
@@ -403,7 +498,7 @@ static void test_split(record_t **record_table, uint32_t id, size_t size) {
             size_t alloc_size = get_size(split_block);
             split_block = (memory_block_t *)((char *)(split_block) - original_size + alloc_size);
             size_t new_size = get_size(split_block);
-            if (alloc_size >= ALIGN(size) && new_size + alloc_size + sizeof(memory_block_t) - size_offset == original_size) {
+            if (alloc_size >= ALIGN(size) && new_size + alloc_size + HEADER_SIZE - size_offset == original_size) {
                 sprintf(printbuf, "New sizes: %ld free, %ld allocated.", new_size, alloc_size);
                 logging(LOG_INFO, printbuf);
             }
@@ -429,15 +524,20 @@ static void test_coalesce(record_t **record_table, uint32_t id) {
 
     size_t target_size = original_size;
     if (can_coalesce_left) {
-        target_size += get_size(prev) + sizeof(memory_block_t) - size_offset;
+        target_size += get_size(prev) + HEADER_SIZE - size_offset;
     }
     if (can_coalesce_right) {
-        target_size += get_size(next) + sizeof(memory_block_t) - size_offset;
+        target_size += get_size(next) + HEADER_SIZE - size_offset;
     }
 
     sprintf(printbuf, "Testing coalesce on a block with an initial size of %ld:", get_size(block));
     logging(LOG_INFO, printbuf);
 
+    /* coalesce expects a block that was just freed, not one already on a free list */
+    if (!is_allocated(block)) {
+        remove_free_block(block);
+    }
+
     memory_block_t *coalesced_block = coalesce(block);
     if (!coalesced_block) {
         sprintf(printbuf, "Coalesce returned NULL.\n");
@@ -520,4 +620,763 @@ static void test_coalesce(record_t **record_table, uint32_t id) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+ * The tests below go through the public API instead of a hand built heap.
+ * Each one starts a fresh heap with uinit_config(), so they go in a test
+ * file of their own, such as api.txt.
+ */
+static void start_heap(const umalloc_config_t *config) {
+    if (uinit_config(config)) {
+        logging(LOG_FATAL, "Could not initialize the heap.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Write a pattern that differs per byte and per seed, so moved or overlapping payloads show up. */
+static void fill_payload(void *payload, size_t size, size_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        ((unsigned char *) payload)[i] = (unsigned char) (i * 31 + seed * 17 + 1);
+    }
+}
+
+static bool check_payload(void *payload, size_t size, size_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        if (((unsigned char *) payload)[i] != (unsigned char) (i * 31 + seed * 17 + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_slab(size_t count, size_t size) {
+    sprintf(printbuf, "Testing %ld slab slots of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(count, sizeof(void *));
+    slab_t **slabs = calloc(count, sizeof(slab_t *));
+    size_t num_slabs = 0;
+
+    start_heap(NULL);
+    for (size_t i = 0; i < count; i++) {
+        payloads[i] = umalloc(size);
+        slab_t *slab = payloads[i] ? get_slab(payloads[i]) : NULL;
+        if (!slab || slab->slot_size < size) {
+            sprintf(printbuf, "Allocation %ld at %p is not a slot big enough.\n", i, payloads[i]);
+            logging(LOG_ERROR, printbuf);
+            count = i;
+            break;
+        }
+        fill_payload(payloads[i], size, i);
+        if (!num_slabs || slabs[num_slabs - 1] != slab) {
+            slabs[num_slabs++] = slab;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!check_payload(payloads[i], size, i)) {
+            sprintf(printbuf, "Slot %ld at %p overlaps another one.\n", i, payloads[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+    }
+
+    /* slots that went back to their slab are handed out again instead of carving a new slab */
+    for (size_t i = 0; i < count; i += 2) {
+        ufree(payloads[i]);
+    }
+    tcache_flush();
+    size_t hits = 0;
+    for (size_t i = 0; i < count; i += 2) {
+        payloads[i] = umalloc(size);
+        for (size_t j = 0; j < num_slabs; j++) {
+            if (payloads[i] && get_slab(payloads[i]) == slabs[j]) {
+                hits++;
+                break;
+            }
+        }
+    }
+    if (hits != (count + 1) / 2) {
+        sprintf(printbuf, "Only %ld of %ld requests reused a slot of the %ld slabs.\n", hits, (count + 1) / 2, num_slabs);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Reused %ld slots of the %ld slabs.", hits, num_slabs);
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+
+    /* every slab but one per class becomes an ordinary free block once empty */
+    for (size_t i = 0; i < count; i++) {
+        ufree(payloads[i]);
+    }
+    tcache_flush();
+    size_t kept = 0;
+    for (size_t i = 0; i < num_slabs; i++) {
+        kept += get_slab(slabs[i]) != NULL;
+    }
+    if (num_slabs && kept != 1) {
+        sprintf(printbuf, "%ld of %ld empty slabs were kept.\n", kept, num_slabs);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Returned %ld empty slabs to the heap.", num_slabs - kept);
+        logging(LOG_INFO, printbuf);
+    }
+    free(slabs);
+    free(payloads);
+}
+
+static void test_realloc(size_t size, size_t new_size) {
+    sprintf(printbuf, "Testing realloc from %ld to %ld bytes:", size, new_size);
+    logging(LOG_INFO, printbuf);
+    size_t kept = size < new_size ? size : new_size;
+
+    /* the second round blocks growth in place with a neighbor, the third by moving the program break */
+    for (int round = 0; round < 3; round++) {
+        start_heap(NULL);
+        void *payload = umalloc(size);
+        void *neighbor = round == 1 ? umalloc(size) : NULL;
+        if (round == 2) {
+            csbrk(PAGESIZE);
+        }
+        if (!payload || (round == 1 && !neighbor)) {
+            sprintf(printbuf, "Umalloc returned NULL.\n");
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        fill_payload(payload, size, round);
+        void *resized = urealloc(payload, new_size);
+        if (!resized) {
+            sprintf(printbuf, "Urealloc returned NULL.\n");
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        const char *how = resized == payload ? "in place" : "by moving";
+        if (umalloc_usable_size(resized) < new_size) {
+            sprintf(printbuf, "Resized %s to %ld usable bytes.\n", how, umalloc_usable_size(resized));
+            logging(LOG_ERROR, printbuf);
+        }
+        else if (!check_payload(resized, kept, round)) {
+            sprintf(printbuf, "Resized %s, but the first %ld bytes changed.\n", how, kept);
+            logging(LOG_ERROR, printbuf);
+        }
+        else {
+            sprintf(printbuf, "Resized %s, the first %ld bytes were kept.", how, kept);
+            logging(LOG_INFO, printbuf);
+        }
+        run_heap_check();
+        ufree(resized);
+        if (neighbor) {
+            ufree(neighbor);
+        }
+        umalloc_stats_t stats;
+        umalloc_stats(&stats);
+        if (stats.counters.bytes_in_use) {
+            sprintf(printbuf, "Stats count %ld bytes in use after freeing the resized block.\n", stats.counters.bytes_in_use);
+            logging(LOG_ERROR, printbuf);
+        }
+    }
+}
+
+static void test_calloc(size_t nmemb, size_t size) {
+    sprintf(printbuf, "Testing calloc of %ld elements of %ld bytes:", nmemb, size);
+    logging(LOG_INFO, printbuf);
+    size_t total = nmemb * size;
+
+    start_heap(NULL);
+    /* the first round gets memory fresh from the OS, the second the same memory dirtied and freed */
+    for (int round = 0; round < 2; round++) {
+        unsigned char *payload = ucalloc(nmemb, size);
+        if (!payload) {
+            sprintf(printbuf, "Ucalloc returned NULL.\n");
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        size_t dirty = 0;
+        while (dirty < total && !payload[dirty]) {
+            dirty++;
+        }
+        const char *memory = round ? "reused" : "fresh";
+        if (dirty < total) {
+            sprintf(printbuf, "Byte %ld of %s memory is not zero.\n", dirty, memory);
+            logging(LOG_ERROR, printbuf);
+        }
+        else {
+            sprintf(printbuf, "All %ld bytes of %s memory are zero.", total, memory);
+            logging(LOG_INFO, printbuf);
+        }
+        memset(payload, 0xa5, umalloc_usable_size(payload));
+        ufree(payload);
+    }
+}
+
+static void test_memalign(size_t alignment, size_t size) {
+    sprintf(printbuf, "Testing aligned allocation of %ld bytes at a multiple of %ld:", size, alignment);
+    logging(LOG_INFO, printbuf);
+    const char *names[] = { "umemalign", "uposix_memalign", "ualigned_alloc" };
+    void *payloads[3] = { NULL, NULL, NULL };
+
+    start_heap(NULL);
+    payloads[0] = umemalign(alignment, size);
+    if (uposix_memalign(&payloads[1], alignment, size)) {
+        payloads[1] = NULL;
+    }
+    payloads[2] = ualigned_alloc(alignment, size);
+    for (int i = 0; i < 3; i++) {
+        if (!payloads[i]) {
+            sprintf(printbuf, "%s returned NULL.\n", names[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+        else if ((uintptr_t) payloads[i] % alignment) {
+            sprintf(printbuf, "%s returned %p.\n", names[i], payloads[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+        else if (umalloc_usable_size(payloads[i]) < size) {
+            sprintf(printbuf, "%s returned %ld usable bytes.\n", names[i], umalloc_usable_size(payloads[i]));
+            logging(LOG_ERROR, printbuf);
+        }
+        else {
+            fill_payload(payloads[i], size, i);
+            sprintf(printbuf, "%s returned %p.", names[i], payloads[i]);
+            logging(LOG_INFO, printbuf);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (payloads[i] && !((uintptr_t) payloads[i] % alignment) && !check_payload(payloads[i], size, i)) {
+            sprintf(printbuf, "The payload of %s overlaps another one.\n", names[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+    }
+    /* the padding in front of an aligned block must still be a valid free block */
+    run_heap_check();
+    for (int i = 0; i < 3; i++) {
+        ufree(payloads[i]);
+    }
+}
+
+static void test_batch(size_t count, size_t size) {
+    sprintf(printbuf, "Testing a batch of %ld allocations of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(count, sizeof(void *));
+    umalloc_stats_t stats;
+
+    start_heap(NULL);
+    size_t allocated = umalloc_batch(size, count, payloads);
+    if (allocated != count) {
+        sprintf(printbuf, "Umalloc_batch allocated %ld blocks.\n", allocated);
+        logging(LOG_ERROR, printbuf);
+    }
+    size_t usable = 0;
+    for (size_t i = 0; i < allocated; i++) {
+        if ((uintptr_t) payloads[i] % ALIGNMENT || umalloc_usable_size(payloads[i]) < size) {
+            sprintf(printbuf, "Block %ld at %p has %ld usable bytes.\n", i, payloads[i], umalloc_usable_size(payloads[i]));
+            logging(LOG_ERROR, printbuf);
+            allocated = i;
+            break;
+        }
+        usable += umalloc_usable_size(payloads[i]);
+        fill_payload(payloads[i], size, i);
+    }
+    for (size_t i = 0; i < allocated; i++) {
+        if (!check_payload(payloads[i], size, i)) {
+            sprintf(printbuf, "Block %ld at %p overlaps another one.\n", i, payloads[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+    }
+    umalloc_stats(&stats);
+    if (stats.counters.malloc_calls != allocated || stats.counters.bytes_in_use != usable) {
+        sprintf(printbuf, "Stats count %ld allocations and %ld bytes in use, expected %ld and %ld.\n",
+            stats.counters.malloc_calls, stats.counters.bytes_in_use, allocated, usable);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Allocated %ld blocks holding %ld usable bytes.", allocated, usable);
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+
+    ufree_batch(payloads, allocated);
+    umalloc_stats(&stats);
+    if (stats.counters.free_calls != allocated || stats.counters.bytes_in_use) {
+        sprintf(printbuf, "Stats count %ld frees and %ld bytes in use after freeing the batch.\n",
+            stats.counters.free_calls, stats.counters.bytes_in_use);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Freed the batch, no bytes in use.");
+        logging(LOG_INFO, printbuf);
+    }
+
+    /* holes that each fit one block must be used up before the heap grows */
+    void **neighbors = calloc(2 * count, sizeof(void *));
+    for (size_t i = 0; i < 2 * count; i++) {
+        neighbors[i] = umalloc(size);
+    }
+    for (size_t i = 0; i < 2 * count; i += 2) {
+        ufree(neighbors[i]);
+        neighbors[i] = NULL;
+    }
+    umalloc_stats(&stats);
+    size_t footprint = stats.footprint;
+    bool mmapped = stats.mmap_count > 0;
+    allocated = umalloc_batch(size, count, payloads);
+    umalloc_stats(&stats);
+    if (!mmapped && stats.footprint > footprint) {
+        sprintf(printbuf, "The batch grew the footprint from %ld to %ld bytes instead of filling %ld holes.\n", footprint, stats.footprint, count);
+        logging(LOG_ERROR, printbuf);
+    }
+    else if (!mmapped) {
+        sprintf(printbuf, "Allocated %ld blocks into the holes between others.", allocated);
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+    ufree_batch(payloads, allocated);
+    ufree_batch(neighbors, 2 * count);
+    free(neighbors);
+    free(payloads);
+}
+
+static void test_sized_free(size_t count, size_t size) {
+    sprintf(printbuf, "Testing sized frees of %ld allocations of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(count, sizeof(void *));
+    size_t *sizes = calloc(count, sizeof(size_t));
+    umalloc_stats_t stats;
+
+    start_heap(NULL);
+    for (size_t i = 0; i < count; i++) {
+        sizes[i] = size;
+        payloads[i] = i % 2 ? ucalloc(1, size) : umalloc(size);
+    }
+    umalloc_stats(&stats);
+    size_t footprint = stats.footprint;
+    /* free every other block and refill the holes with a smaller size, which can leave slack behind the request */
+    for (size_t i = 0; i < count; i += 2) {
+        ufree_sized(payloads[i], sizes[i]);
+    }
+    tcache_flush();
+    for (size_t i = 0; i < count; i += 2) {
+        sizes[i] = size > ALIGNMENT ? size - ALIGNMENT : size;
+        payloads[i] = umalloc(sizes[i]);
+    }
+
+    size_t usable = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!payloads[i]) {
+            sprintf(printbuf, "Allocation %ld returned NULL.\n", i);
+            logging(LOG_ERROR, printbuf);
+            count = i;
+            break;
+        }
+        usable += umalloc_usable_size(payloads[i]);
+        fill_payload(payloads[i], sizes[i], i);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!check_payload(payloads[i], sizes[i], i)) {
+            sprintf(printbuf, "Block %ld at %p overlaps another one.\n", i, payloads[i]);
+            logging(LOG_ERROR, printbuf);
+        }
+    }
+    umalloc_stats(&stats);
+    if (stats.counters.bytes_in_use != usable) {
+        sprintf(printbuf, "Stats count %ld bytes in use, expected %ld.\n", stats.counters.bytes_in_use, usable);
+        logging(LOG_ERROR, printbuf);
+    }
+    /* slab slots only serve their own class, so smaller slab sizes need a new slab */
+    if (size > SLAB_LIMIT && stats.footprint > footprint) {
+        sprintf(printbuf, "The footprint grew from %ld to %ld bytes instead of reusing freed memory.\n", footprint, stats.footprint);
+        logging(LOG_ERROR, printbuf);
+    }
+    run_heap_check();
+
+    for (size_t i = 0; i < count; i++) {
+        ufree_sized(payloads[i], sizes[i]);
+    }
+    /* cached blocks are only counted as free up to their class size until they leave the cache */
+    tcache_flush();
+    umalloc_stats(&stats);
+    if (stats.counters.bytes_in_use) {
+        sprintf(printbuf, "Stats count %ld bytes in use after freeing everything.\n", stats.counters.bytes_in_use);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Freed %ld blocks holding %ld usable bytes, no bytes in use.", count, usable);
+        logging(LOG_INFO, printbuf);
+    }
+    free(sizes);
+    free(payloads);
+}
+
+static void test_trim(size_t count, size_t size) {
+    sprintf(printbuf, "Testing trimming after freeing %ld allocations of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(count, sizeof(void *));
+    /* only umalloc_trim gives memory back, frees never reach the threshold */
+    umalloc_config_t config = { .trim_threshold = (size_t) 1 << 40 };
+    umalloc_stats_t stats;
+
+    start_heap(&config);
+    for (size_t i = 0; i < count; i++) {
+        if (!(payloads[i] = umalloc(size))) {
+            sprintf(printbuf, "Allocation %ld returned NULL.\n", i);
+            logging(LOG_ERROR, printbuf);
+            free(payloads);
+            return;
+        }
+        fill_payload(payloads[i], size, i);
+    }
+    umalloc_stats(&stats);
+    size_t footprint = stats.footprint;
+
+    /* the blocks in between leave a hole whose whole pages can be decommitted */
+    for (size_t i = 1; i < count - 1; i++) {
+        ufree(payloads[i]);
+    }
+    if (!umalloc_trim(0)) {
+        sprintf(printbuf, "Umalloc_trim released nothing from the freed interior.\n");
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Umalloc_trim decommitted the freed interior.");
+        logging(LOG_INFO, printbuf);
+    }
+    if (!check_payload(payloads[0], size, 0) || !check_payload(payloads[count - 1], size, count - 1)) {
+        sprintf(printbuf, "Trimming changed the blocks around the hole.\n");
+        logging(LOG_ERROR, printbuf);
+    }
+    run_heap_check();
+
+    /* decommitted pages read as zero, but the links and tags written since must be cleared */
+    size_t hole = (count - 2) * size;
+    unsigned char *refill = ucalloc(1, hole);
+    size_t dirty = 0;
+    while (refill && dirty < hole && !refill[dirty]) {
+        dirty++;
+    }
+    if (!refill || dirty < hole) {
+        sprintf(printbuf, "Ucalloc over the decommitted hole returned %p with byte %ld not zero.\n", refill, dirty);
+        logging(LOG_ERROR, printbuf);
+    }
+    ufree(refill);
+
+    /* with the last block gone the free top of the heap can go back to the OS */
+    ufree(payloads[count - 1]);
+    umalloc_trim(0);
+    umalloc_stats(&stats);
+    if (stats.footprint >= footprint) {
+        sprintf(printbuf, "The footprint is %ld bytes after trimming the top, it was %ld.\n", stats.footprint, footprint);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Trimming the top shrank the footprint from %ld to %ld bytes.", footprint, stats.footprint);
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+    ufree(payloads[0]);
+    free(payloads);
+}
+
+static void test_deferred(size_t count, size_t size) {
+    sprintf(printbuf, "Testing deferred coalescing of %ld frees of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(count, sizeof(void *));
+    void **reused = calloc(count, sizeof(void *));
+    /* one chunk holds all the blocks and less than a page more, so once merged they form the only free block that fits them */
+    umalloc_config_t config = { .defer_coalescing = true, .initial_heap = count * BLOCK_SIZE(size) + CHUNK_OVERHEAD };
+    umalloc_stats_t stats;
+
+    start_heap(&config);
+    for (size_t i = 0; i < count; i++) {
+        if (!(payloads[i] = umalloc(size))) {
+            sprintf(printbuf, "Allocation %ld returned NULL.\n", i);
+            logging(LOG_ERROR, printbuf);
+            count = i;
+            break;
+        }
+    }
+    umalloc_stats(&stats);
+    size_t coalesces = stats.counters.coalesces;
+    for (size_t i = 0; i < count; i++) {
+        ufree(payloads[i]);
+    }
+    if (count < DEFERRED_LIMIT) {
+        umalloc_stats(&stats);
+        if (stats.counters.coalesces != coalesces) {
+            sprintf(printbuf, "%ld coalesces while fewer than DEFERRED_LIMIT frees were held back.\n", stats.counters.coalesces - coalesces);
+            logging(LOG_ERROR, printbuf);
+        }
+        /* held back blocks go to requests of the same size as they are */
+        size_t hits = 0;
+        for (size_t i = 0; i < count; i++) {
+            reused[i] = umalloc(size);
+            for (size_t j = 0; j < count; j++) {
+                if (reused[i] == payloads[j]) {
+                    hits++;
+                    break;
+                }
+            }
+        }
+        if (hits != count) {
+            sprintf(printbuf, "Only %ld of %ld allocations reused a held back block.\n", hits, count);
+            logging(LOG_ERROR, printbuf);
+        }
+        else {
+            sprintf(printbuf, "Frees were held back and reused without coalescing.");
+            logging(LOG_INFO, printbuf);
+        }
+        run_heap_check();
+        for (size_t i = 0; i < count; i++) {
+            ufree(reused[i]);
+        }
+    }
+
+    /* nothing listed fits a request for the whole run, so it merges the held back frees */
+    void *merged = umalloc(count * BLOCK_SIZE(size) - HEADER_SIZE);
+    if (merged != payloads[0]) {
+        sprintf(printbuf, "A request for all %ld blocks returned %p instead of the first block at %p.\n", count, merged, payloads[0]);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "The held back frees merged into one block.");
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+    ufree(merged);
+    free(reused);
+    free(payloads);
+}
+
+/* Round size up to whole pages, at least one, the way uinit_config() rounds its tunables. */
+static size_t whole_pages(size_t size) {
+    size = (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+    return size > PAGESIZE ? size : PAGESIZE;
+}
+
+static void test_growth(size_t initial_heap, size_t min_chunk, size_t max_chunk) {
+    sprintf(printbuf, "Testing heap growth from %ld bytes by %ld to %ld bytes at a time:", initial_heap, min_chunk, max_chunk);
+    logging(LOG_INFO, printbuf);
+    umalloc_config_t config = { .initial_heap = initial_heap, .min_chunk = min_chunk, .max_chunk = max_chunk };
+    umalloc_stats_t stats;
+    /* uinit_config() rounds the tunables up to whole pages */
+    initial_heap = whole_pages(initial_heap);
+    min_chunk = whole_pages(min_chunk);
+    max_chunk = whole_pages(max_chunk);
+    /* each 1000 byte request that finds no room asks for its own pages and one more */
+    size_t needed = 2 * PAGESIZE;
+    size_t fixed = needed > min_chunk ? needed : min_chunk;
+
+    start_heap(&config);
+    umalloc_stats(&stats);
+    size_t heap = stats.footprint - stats.mmap_bytes;
+    if (heap != initial_heap) {
+        sprintf(printbuf, "The initial heap took %ld bytes.\n", heap);
+        logging(LOG_ERROR, printbuf);
+        return;
+    }
+    size_t calls = stats.csbrk_calls;
+    size_t avoided = 0;
+    for (size_t streak = 0; streak < 8;) {
+        if (!umalloc(1000)) {
+            sprintf(printbuf, "Umalloc returned NULL.\n");
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        umalloc_stats(&stats);
+        if (stats.csbrk_calls == calls) {
+            continue;
+        }
+        /* an eighth of the heap, or min_chunk doubled for up to four extensions in a row, within max_chunk */
+        size_t expected = min_chunk << (streak < 4 ? streak : 4);
+        expected = heap / 8 > expected ? heap / 8 : expected;
+        expected = (expected + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+        expected = expected < max_chunk ? expected : max_chunk;
+        expected = expected > needed ? expected : needed;
+        size_t grown = stats.footprint - stats.mmap_bytes - heap;
+        if (stats.csbrk_calls != calls + 1 || grown != expected) {
+            sprintf(printbuf, "Extension %ld took %ld calls for %ld bytes, expected one for %ld.\n", streak, stats.csbrk_calls - calls, grown, expected);
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        avoided += expected > fixed ? (expected - fixed) / min_chunk : 0;
+        heap += grown;
+        calls = stats.csbrk_calls;
+        streak++;
+    }
+    if (stats.csbrk_avoided != avoided) {
+        sprintf(printbuf, "Stats count %ld avoided csbrk calls, expected %ld.\n", stats.csbrk_avoided, avoided);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Grew to %ld bytes as expected, avoiding %ld csbrk calls.", heap, avoided);
+        logging(LOG_INFO, printbuf);
+    }
+}
+
+static void test_chunks(size_t size) {
+    sprintf(printbuf, "Testing a %ld byte request that outgrows the first chunk:", size);
+    logging(LOG_INFO, printbuf);
+
+    /* the second round moves the program break first, so the new chunk cannot follow the first one */
+    for (int round = 0; round < 2; round++) {
+        start_heap(NULL);
+        void *end = sbrk(0);
+        if (round) {
+            csbrk(PAGESIZE);
+        }
+        void *payload = umalloc(size);
+        if (!payload) {
+            sprintf(printbuf, "Umalloc returned NULL.\n");
+            logging(LOG_ERROR, printbuf);
+            return;
+        }
+        fill_payload(payload, size, round);
+        if (!round && (payload > end || payload + size <= end)) {
+            sprintf(printbuf, "The block at %p does not span the end of the first chunk at %p.\n", payload, end);
+            logging(LOG_ERROR, printbuf);
+        }
+        else if (round && payload < end + PAGESIZE) {
+            sprintf(printbuf, "The block at %p spans memory someone else got at %p.\n", payload, end);
+            logging(LOG_ERROR, printbuf);
+        }
+        else if (!check_payload(payload, size, round)) {
+            sprintf(printbuf, "The block at %p was overwritten.\n", payload);
+            logging(LOG_ERROR, printbuf);
+        }
+        else {
+            sprintf(printbuf, round ? "Added a chunk of its own behind memory someone else got." : "Merged the new chunk into the first one.");
+            logging(LOG_INFO, printbuf);
+        }
+        run_heap_check();
+        ufree(payload);
+    }
+}
+
+/* Sum the searches in the histogram and find the highest bucket any of them landed in. */
+static size_t count_searches(const umalloc_stats_t *stats, size_t *longest) {
+    size_t searches = 0;
+    *longest = 0;
+    for (size_t bucket = 0; bucket < STATS_SEARCH_BUCKETS; bucket++) {
+        searches += stats->counters.search_lengths[bucket];
+        if (stats->counters.search_lengths[bucket]) {
+            *longest = bucket;
+        }
+    }
+    return searches;
+}
+
+static void test_histogram(size_t count, size_t size) {
+    sprintf(printbuf, "Testing the statistics of %ld allocations of %ld bytes:", count, size);
+    logging(LOG_INFO, printbuf);
+    void **payloads = calloc(2 * count, sizeof(void *));
+    umalloc_stats_t stats;
+    size_t longest;
+
+    /* every allocation that misses the cache searches once, even when the heap grows after it */
+    start_heap(NULL);
+    for (size_t i = 0; i < count; i++) {
+        payloads[i] = umalloc(size);
+    }
+    umalloc_stats(&stats);
+    size_t searches = count_searches(&stats, &longest);
+    if (searches != count) {
+        sprintf(printbuf, "Stats count %ld searches for %ld allocations.\n", searches, count);
+        logging(LOG_ERROR, printbuf);
+    }
+    /* blocks freed into their exact class are found by the first look */
+    for (size_t i = 0; i < count; i += 2) {
+        ufree(payloads[i]);
+    }
+    tcache_flush();
+    size_t exact = stats.counters.search_lengths[1];
+    for (size_t i = 0; i < count; i += 2) {
+        payloads[i] = umalloc(size);
+    }
+    umalloc_stats(&stats);
+    if (count_searches(&stats, &longest) - searches != (count + 1) / 2 || stats.counters.search_lengths[1] - exact != (count + 1) / 2) {
+        sprintf(printbuf, "Reusing %ld exact blocks counted %ld searches, %ld of them of length 1.\n",
+            (count + 1) / 2, count_searches(&stats, &longest) - searches, stats.counters.search_lengths[1] - exact);
+        logging(LOG_ERROR, printbuf);
+    }
+
+    /* holes of distinct large sizes fill the tree, a request bigger than all of them walks it to the bottom */
+    for (size_t i = 0; i < count; i++) {
+        payloads[count + i] = umalloc(SMALL_CLASS_LIMIT + 2 * ALIGNMENT * i);
+        umalloc(size);
+    }
+    for (size_t i = 0; i < count; i++) {
+        ufree(payloads[count + i]);
+    }
+    umalloc_stats(&stats);
+    searches = count_searches(&stats, &longest);
+    void *large = umalloc(SMALL_CLASS_LIMIT + 2 * ALIGNMENT * count);
+    umalloc_stats(&stats);
+    /* a red-black tree of three or more nodes is two levels deep on every path, so the walk is counted in bucket 2 or above */
+    if (count_searches(&stats, &longest) != searches + 1 || longest < 2) {
+        sprintf(printbuf, "A search through %ld tree nodes was counted %ld times, the longest in bucket %ld.\n",
+            count + 1, count_searches(&stats, &longest) - searches, longest);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "Counted %ld searches, the longest in bucket %ld.", searches + 1, longest);
+        logging(LOG_INFO, printbuf);
+    }
+
+    /* a mapped block raises the peak, which stays when it is unmapped */
+    size_t footprint = stats.footprint;
+    size_t length = 64 * PAGESIZE;
+    ufree(umalloc(length));
+    umalloc_stats(&stats);
+    if (stats.footprint != footprint || stats.peak_footprint < footprint + length) {
+        sprintf(printbuf, "After mapping %ld bytes the footprint went from %ld to %ld bytes, peaking at %ld.\n",
+            length, footprint, stats.footprint, stats.peak_footprint);
+        logging(LOG_ERROR, printbuf);
+    }
+    else {
+        sprintf(printbuf, "The footprint peaked at %ld bytes.", stats.peak_footprint);
+        logging(LOG_INFO, printbuf);
+    }
+    run_heap_check();
+    ufree(large);
+    free(payloads);
+}
+
+/* Log an error naming the call when an oversized request was not refused. */
+static void expect_refused(const char *call, bool refused) {
+    if (refused) {
+        sprintf(printbuf, "%s was refused.", call);
+        logging(LOG_INFO, printbuf);
+    }
+    else {
+        sprintf(printbuf, "%s succeeded.\n", call);
+        logging(LOG_ERROR, printbuf);
+    }
+}
+
+static void test_overflow() {
+    sprintf(printbuf, "Testing requests whose size overflows:");
+    logging(LOG_INFO, printbuf);
+    void *payload;
+    void *out[4];
+
+    start_heap(NULL);
+    expect_refused("umalloc(SIZE_MAX)", !umalloc(SIZE_MAX));
+    expect_refused("umalloc(MAX_REQUEST + 1)", !umalloc(MAX_REQUEST + 1));
+    expect_refused("ucalloc(SIZE_MAX / 2 + 1, 2)", !ucalloc(SIZE_MAX / 2 + 1, 2));
+    expect_refused("ucalloc(1, SIZE_MAX - 8)", !ucalloc(1, SIZE_MAX - 8));
+    expect_refused("umemalign(64, SIZE_MAX - 10)", !umemalign(64, SIZE_MAX - 10));
+    expect_refused("umemalign(PAGESIZE, MAX_REQUEST)", !umemalign(PAGESIZE, MAX_REQUEST));
+    expect_refused("ualigned_alloc(PAGESIZE, SIZE_MAX - 100)", !ualigned_alloc(PAGESIZE, SIZE_MAX - 100));
+    expect_refused("uposix_memalign(&payload, 64, SIZE_MAX - 10)", uposix_memalign(&payload, 64, SIZE_MAX - 10) == ENOMEM);
+    expect_refused("uposix_memalign(&payload, 0, 16)", uposix_memalign(&payload, 0, 16) == EINVAL);
+    expect_refused("umalloc_batch(SIZE_MAX, 4, out)", umalloc_batch(SIZE_MAX, 4, out) == 0);
+
+    /* a refused urealloc leaves the block as it was */
+    payload = umalloc(100);
+    fill_payload(payload, 100, 0);
+    expect_refused("urealloc(payload, SIZE_MAX - 3)", !urealloc(payload, SIZE_MAX - 3));
+    expect_refused("urealloc(payload, MAX_REQUEST + 1)", !urealloc(payload, MAX_REQUEST + 1));
+    if (!check_payload(payload, 100, 0)) {
+        sprintf(printbuf, "A refused urealloc changed the block.\n");
+        logging(LOG_ERROR, printbuf);
+    }
+    ufree(payload);
+}